@@ -1,11 +1,150 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE	// madvise, ftruncate, pread/pwrite under -std=c11
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdatomic.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "fec.h"
+
+
+/* STATISTICS */
+
+// With FEC_STATS undefined, all of this compiles down to nothing.
+
+#ifdef FEC_STATS
+
+// Each thread's own counters, zeroed when it starts, unless it has
+// chosen others (a thread local can't start out pointing at another)
+static _Thread_local struct fecstats fecstats_own;
+static _Thread_local struct fecstats *fecstats_cur;
+
+static inline struct fecstats *stat_cur(void)
+{
+	return fecstats_cur ? fecstats_cur : &fecstats_own;
+}
+
+static unsigned long long stat_now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (unsigned long long) t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+#define STAT_ADD(field, n)	(stat_cur()->field += (n))
+#define STAT_START(t)		unsigned long long t = stat_now()
+#define STAT_STOP(st, t, bin, bout, nw) do {			\
+		struct fecstats *st_ = stat_cur();		\
+		st_->ns[st] += stat_now() - (t);		\
+		st_->in[st] += (bin);				\
+		st_->out[st] += (bout);				\
+		st_->words[st] += (nw);				\
+	} while (0)
+
+void fecstats_use(struct fecstats *s)
+{
+	fecstats_cur = s;
+}
+
+void fecstats_snap(struct fecstats *dst)
+{
+	*dst = *stat_cur();
+}
+
+void fecstats_reset(void)
+{
+	memset(stat_cur(), 0, sizeof(struct fecstats));
+}
+
+// Add counters gathered on another thread into this thread's
+static void stat_merge(const struct fecstats *s)
+{
+	const unsigned long long *src = (const unsigned long long *) s;
+	unsigned long long *dst = (unsigned long long *) stat_cur();
+	for (size_t i = 0; i < sizeof(*s) / sizeof(*src); i++)
+		dst[i] += src[i];
+}
+
+#else
+
+#define STAT_ADD(field, n)	((void) 0)
+#define STAT_START(t)		((void) 0)
+#define STAT_STOP(st, t, bin, bout, nw)	((void) 0)
+
+void fecstats_use(struct fecstats *s)
+{
+	(void) s;
+}
+
+void fecstats_snap(struct fecstats *dst)
+{
+	memset(dst, 0, sizeof(*dst));
+}
+
+void fecstats_reset(void)
+{
+}
+
+static void stat_merge(const struct fecstats *s)
+{
+	(void) s;
+}
+
+#endif
 
 
 /* There is a distinct lack of error checking which should probably be fixed. */
 
 
+/* PACKET LENGTH */
+
+// Packet functions called with plen (length) 0 use this one; set it
+// with setplen, e.g. from tuneplen's pick.
+static unsigned int plen_auto = 1000;
+
+// plen for a function called with plen = 0
+static unsigned int plenof(unsigned int plen)
+{
+	return plen ? plen : plen_auto;
+}
+
+// 0 goes back to the default
+void setplen(unsigned int plen)
+{
+	plen_auto = plen ? plen : 1000;
+}
+
+unsigned int getplen(void)
+{
+	return plen_auto;
+}
+
+
+
 /* UDP HEADER ADDER */
 
 /* There are 4 components to a UDP header:
@@ -69,6 +208,7 @@ int addUDP(unsigned int length, FILE *out)
 // returns number of packet headers added
 int inlvUDP(unsigned int length, FILE *in, FILE *out)
 {
+	length = plenof(length);
 	int end = 0;
 	int next = 0;
 	unsigned char c = 0x00;
@@ -80,6 +220,7 @@ int inlvUDP(unsigned int length, FILE *in, FILE *out)
 	if (length > 1 && length < 8)
 		return -1;
 
+	STAT_START(t0);
 	while (!end)
 	{
 		addUDP(length, out);
@@ -102,6 +243,8 @@ int inlvUDP(unsigned int length, FILE *in, FILE *out)
 			fputc(c,out);
 		}
 	}
+	STAT_STOP(ST_INLVUDP, t0, (unsigned long long) pcount * length,
+		(unsigned long long) pcount * (length + 8), pcount);
 	return pcount;
 }
 
@@ -114,19 +257,25 @@ int inlvUDP(unsigned int length, FILE *in, FILE *out)
 // In particular, if the length is wrong, this function just drops the packet
 
 // pnum = number of packets added; plen = packet length
+// returns number of packets dropped
 int decUDP(int pnum, unsigned int plen, FILE *in, FILE *out)
 {
+	plen = plenof(plen);
 	unsigned char c;
 	int pcounter = 0;
 	int droppack;
+	int dropped = 0;
+	int reason;
 
 	// because testing length by each byte
 	unsigned char lengthLo = (unsigned char) plen;
 	unsigned char lengthHi = (unsigned char) (plen >> 8);
 
+	STAT_START(t0);
 	while (pcounter < pnum)
 	{
 		droppack = 0;
+		reason = 0; // first bad field: 1 port, 2 length, 3 checksum
 		// First, check packet header to see if dropped
 		c = fgetc(in); // first is source port
 		c = fgetc(in); // (each fgetc returns 8 bits)
@@ -137,6 +286,8 @@ int decUDP(int pnum, unsigned int plen, FILE *in, FILE *out)
 		c = fgetc(in); // dest port again
 		if (c != 0xff)
 			droppack = 1;
+		if (droppack && !reason)
+			reason = 1;
 
 		c = fgetc(in); // length (tested by each byte)
 		if (c != lengthLo)
@@ -144,6 +295,8 @@ int decUDP(int pnum, unsigned int plen, FILE *in, FILE *out)
 		c = fgetc(in);
 		if (c != lengthHi)
 			droppack = 1;
+		if (droppack && !reason)
+			reason = 2;
 
 		c = fgetc(in); // checksum
 		if (c != 0x00)
@@ -151,10 +304,19 @@ int decUDP(int pnum, unsigned int plen, FILE *in, FILE *out)
 		c = fgetc(in); // checksum, part 2
 		if (c != 0x00)
 			droppack = 1;
+		if (droppack && !reason)
+			reason = 3;
 
 		// If so, write all 0s; else, write data
 		if (droppack)
 		{
+			dropped++;
+			if (reason == 1)
+				STAT_ADD(drop_port, 1);
+			else if (reason == 2)
+				STAT_ADD(drop_len, 1);
+			else
+				STAT_ADD(drop_csum, 1);
 			for (unsigned int i = 0; i < plen; i++)
 			{
 				c = fgetc(in); // still fgetc for count
@@ -171,7 +333,298 @@ int decUDP(int pnum, unsigned int plen, FILE *in, FILE *out)
 		}
 		pcounter++;
 	}
-	return 0;
+	STAT_STOP(ST_DECUDP, t0, (unsigned long long) pnum * (plen + 8),
+		(unsigned long long) pnum * plen, pnum);
+	return dropped;
+}
+
+
+
+/* PACKET CRC */
+
+/* CRC-32C (Castagnoli) trailer on each packet, so packets that got past
+ * the header check with bit errors in the payload can be told apart and
+ * handed to the erasure decoders as lost, instead of as good data.
+ *
+ * With SSE4.2 the crc32 instruction does 8 bytes per step; otherwise
+ * slicing-by-8 tables do the same 8 bytes per step in software.
+ */
+
+#ifndef __SSE4_2__
+
+static uint32_t crc_tab[8][256];
+static int crc_ready = 0;
+
+static void crc_init(void)
+{
+	if (crc_ready)
+		return;
+	for (int i = 0; i < 256; i++)
+	{
+		uint32_t c = i;
+		for (int j = 0; j < 8; j++)
+			c = (c >> 1) ^ (0x82f63b78 & -(c & 1));
+		crc_tab[0][i] = c;
+	}
+	for (int i = 0; i < 256; i++)
+		for (int t = 1; t < 8; t++)
+			crc_tab[t][i] = (crc_tab[t-1][i] >> 8) ^ crc_tab[0][crc_tab[t-1][i] & 0xff];
+	crc_ready = 1;
+}
+
+#else
+
+static void crc_init(void)
+{
+}
+
+#endif
+
+// crc = 0 to start, or the result of the previous call to continue
+uint32_t crc32c(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	crc = ~crc;
+#ifdef __SSE4_2__
+	uint64_t c = crc;
+	for (; len >= 8; len -= 8, buf += 8)
+	{
+		uint64_t w;
+		memcpy(&w, buf, 8);
+		c = _mm_crc32_u64(c, w);
+	}
+	crc = (uint32_t) c;
+	for (; len > 0; len--)
+		crc = _mm_crc32_u8(crc, *buf++);
+#else
+	crc_init();
+	for (; len >= 8; len -= 8, buf += 8)
+	{
+		// little endian load, whatever the host
+		uint32_t lo = crc ^ (buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t) buf[3] << 24);
+		crc = crc_tab[7][lo & 0xff] ^ crc_tab[6][(lo >> 8) & 0xff]
+			^ crc_tab[5][(lo >> 16) & 0xff] ^ crc_tab[4][lo >> 24]
+			^ crc_tab[3][buf[4]] ^ crc_tab[2][buf[5]]
+			^ crc_tab[1][buf[6]] ^ crc_tab[0][buf[7]];
+	}
+	for (; len > 0; len--)
+		crc = (crc >> 8) ^ crc_tab[0][(crc ^ *buf++) & 0xff];
+#endif
+	return ~crc;
+}
+
+// Like inlvUDP, but the last 4 bytes of every packet are a CRC-32C of the
+// rest (little endian). length is the whole payload, CRC included.
+// returns number of packets
+int inlvUDPcrc(unsigned int length, FILE *in, FILE *out)
+{
+	length = plenof(length);
+	if (length > 65535 || length < 8)
+		return -1;
+
+	unsigned int dlen = length - 4;
+	unsigned char packet[length];
+	int pcount = 0;
+	size_t got;
+
+	STAT_START(t0);
+	do
+	{
+		got = fread(packet, 1, dlen, in);
+		memset(packet + got, 0, dlen - got);
+		uint32_t crc = crc32c(0, packet, dlen);
+		packet[dlen] = (unsigned char) crc;
+		packet[dlen + 1] = (unsigned char) (crc >> 8);
+		packet[dlen + 2] = (unsigned char) (crc >> 16);
+		packet[dlen + 3] = (unsigned char) (crc >> 24);
+		addUDP(length, out);
+		fwrite(packet, 1, length, out);
+		pcount++;
+	} while (got == dlen);
+	STAT_STOP(ST_INLVUDP, t0, (unsigned long long) pcount * dlen,
+		(unsigned long long) pcount * (length + 8), pcount);
+	return pcount;
+}
+
+// Decode inlvUDPcrc. Packets with a bad header are dropped as in decUDP;
+// packets with a good header but a bad CRC are dropped as well. Either
+// way 0s are written (plen - 4 bytes per packet) and, if eras is not
+// NULL, eras[i] is set to 1 so d_rskm, d_prod or d_rs2x1e can treat
+// packet i as an erasure.
+// returns number of packets erased
+int decUDPcrc(int pnum, unsigned int plen, unsigned char *eras, FILE *in, FILE *out)
+{
+	plen = plenof(plen);
+	if (plen > 65535 || plen < 8)
+		return -1;
+
+	unsigned int dlen = plen - 4;
+	unsigned char frame[plen + 8];
+	unsigned char *packet = frame + 8;
+	int erased = 0;
+
+	STAT_START(t0);
+	for (int p = 0; p < pnum; p++)
+	{
+		size_t got = fread(frame, 1, plen + 8, in);
+		memset(frame + got, 0, plen + 8 - got);
+
+		int bad = 0;
+		if (frame[2] != 0xff || frame[3] != 0xff)
+		{
+			STAT_ADD(drop_port, 1);
+			bad = 1;
+		}
+		else if (frame[4] != (unsigned char) plen || frame[5] != (unsigned char) (plen >> 8))
+		{
+			STAT_ADD(drop_len, 1);
+			bad = 1;
+		}
+		else if (frame[6] != 0x00 || frame[7] != 0x00)
+		{
+			STAT_ADD(drop_csum, 1);
+			bad = 1;
+		}
+		else
+		{
+			uint32_t crc = packet[dlen] | packet[dlen + 1] << 8
+				| packet[dlen + 2] << 16 | (uint32_t) packet[dlen + 3] << 24;
+			if (crc32c(0, packet, dlen) != crc)
+			{
+				STAT_ADD(drop_crc, 1);
+				bad = 1;
+			}
+		}
+
+		if (bad)
+		{
+			memset(packet, 0, dlen);
+			erased++;
+		}
+		if (eras != NULL)
+			eras[p] = (unsigned char) bad;
+		fwrite(packet, 1, dlen, out);
+	}
+	STAT_STOP(ST_DECUDP, t0, (unsigned long long) pnum * (plen + 8),
+		(unsigned long long) pnum * dlen, pnum);
+	return erased;
+}
+
+
+
+/* DATA RANDOMIZER */
+
+/* CCSDS pseudo-randomizer (CCSDS 131.0-B), so long runs of 0s (like the
+ * padding the encoders and decUDP write) don't starve the radio's clock
+ * recovery. h(x) = x^8 + x^7 + x^5 + x^3 + 1, all 1s at the start of
+ * every packet, XORed onto the data: FF 48 0E C0 9A 0D ...
+ * XORing twice gives the data back, so the same XOR undoes it. On the
+ * way back, though, a packet of all 0s is what decUDP wrote for a packet
+ * it dropped, and the decoders that find drops that way (d_rs2x1,
+ * d_rskm, d_rep, d_prod with eras == NULL) need it left as 0s; d_rnd
+ * skips those. (A real packet comes out of rnd as all 0s only if the
+ * data was the randomizer sequence itself.)
+ *
+ * The sequence repeats every 255 bytes. The table holds 8 periods
+ * (2040 bytes, a whole number of 64 bit words), so each 2040 byte
+ * stretch of a packet is one pass of 64 bit XORs.
+ */
+
+#define RND_PERIOD	255
+#define RND_TAB		(8 * RND_PERIOD)
+
+static uint64_t rnd_tab[RND_TAB / 8];
+static int rnd_ready = 0;
+
+static void rnd_init(void)
+{
+	if (rnd_ready)
+		return;
+	unsigned char *t = (unsigned char *) rnd_tab;
+	unsigned int s = 0xff;
+	for (int n = 0; n < RND_TAB; n++)
+	{
+		unsigned char b = 0;
+		for (int i = 0; i < 8; i++)
+		{
+			b = (unsigned char) (b << 1 | (s & 1));
+			unsigned int fb = (s ^ s >> 3 ^ s >> 5 ^ s >> 7) & 1;
+			s = s >> 1 | fb << 7;
+		}
+		t[n] = b;
+	}
+	rnd_ready = 1;
+}
+
+// Randomize (or derandomize) one packet in place
+void rndblk(unsigned char *buf, size_t len)
+{
+	rnd_init();
+	const unsigned char *t = (const unsigned char *) rnd_tab;
+	while (len > 0)
+	{
+		size_t n = len < RND_TAB ? len : RND_TAB;
+		size_t w = 0;
+		for (; w + 8 <= n; w += 8)
+		{
+			uint64_t x;
+			memcpy(&x, buf + w, 8);
+			x ^= rnd_tab[w / 8];
+			memcpy(buf + w, &x, 8);
+		}
+		for (; w < n; w++)
+			buf[w] ^= t[w];
+		buf += n;
+		len -= n;
+	}
+}
+
+static int rnd_zero(const unsigned char *p, size_t len)
+{
+	unsigned char superzip = 0x00;
+	for (size_t i = 0; i < len; i++)
+		superzip |= p[i];
+	return superzip == 0x00;
+}
+
+static int rnd_run(unsigned int plen, int undo, FILE *in, FILE *out)
+{
+	plen = plenof(plen);
+	if (plen == 0 || plen > 65535)
+		return -1;
+
+	unsigned char packet[plen];
+	int pcount = 0;
+	size_t got;
+
+	STAT_START(t0);
+	while ((got = fread(packet, 1, plen, in)) > 0)
+	{
+		if (!undo || !rnd_zero(packet, got))
+			rndblk(packet, got);
+		fwrite(packet, 1, got, out);
+		pcount++;
+		if (got < plen)
+			break;
+	}
+	STAT_STOP(ST_RND, t0, (unsigned long long) pcount * plen,
+		(unsigned long long) pcount * plen, pcount);
+	return pcount;
+}
+
+// Randomize a stream of plen byte packets (restarting the sequence at
+// each packet), before inlvUDP. A short last packet is randomized as far
+// as it goes.
+// returns number of packets
+int rnd(unsigned int plen, FILE *in, FILE *out)
+{
+	return rnd_run(plen, 0, in, out);
+}
+
+// Undo rnd after decUDP; packets of all 0s (dropped) stay 0s
+// returns number of packets
+int d_rnd(unsigned int plen, FILE *in, FILE *out)
+{
+	return rnd_run(plen, 1, in, out);
 }
 
 
@@ -201,7 +654,9 @@ int h74(FILE *in, FILE *out)
 
 	unsigned char c1,c2,c3,c4,c5,c6,c7;
 	int end = 0;
+	unsigned long long words = 0;
 
+	STAT_START(t0);
 	while (!end) {
 
 		// if end of file, flag it but continue to make codes;
@@ -246,7 +701,9 @@ int h74(FILE *in, FILE *out)
 		fputc(c5,out);
 		fputc(c6,out);
 		fputc(c7,out);
+		words++;
 	}
+	STAT_STOP(ST_H74, t0, 4 * words, 7 * words, words);
 	return 0;
 }
 
@@ -258,6 +715,7 @@ int h74(FILE *in, FILE *out)
 // returns total packets sent
 int inlvham(unsigned int plen, FILE *in, FILE *out)
 {
+	plen = plenof(plen);
 	int end = 0;
 	int next = 0;
 	unsigned char c = 0x00;
@@ -270,6 +728,8 @@ int inlvham(unsigned int plen, FILE *in, FILE *out)
 	if (plen > 65535)
 		return -1;
 
+	STAT_START(t0);
+	unsigned long long groups = 0;
 
 	while (!end)
 	{
@@ -313,7 +773,9 @@ int inlvham(unsigned int plen, FILE *in, FILE *out)
 				fputc(packets[i][j],out);
 			}
 		}
+		groups++;
 	}
+	STAT_STOP(ST_INLVHAM, t0, groups * 7 * plen, groups * 7 * plen, groups);
 	return pcount;
 }
 
@@ -367,9 +829,12 @@ unsigned char decoder[3][7];
 int c;
 unsigned char received[7];
 int end = 0;
+unsigned long long words = 0;
 
+STAT_START(t0);
 while (!end)
 {
+	words++;
 	unsigned char syndrome[3] = {0,0,0};
 	for (int i = 0; i < 7; i++)
 	{
@@ -418,6 +883,7 @@ while (!end)
 					     ~(decoder[2][j] ^ syndrome[2]) & mask )
 					{	// switch that bit
 						received[j] ^= mask;
+						STAT_ADD(h74fix[j], 1);
 						break;
 					}
 				}
@@ -429,6 +895,7 @@ while (!end)
 	fputc(received[3],out);
 	}
 }
+STAT_STOP(ST_D_H74, t0, 7 * words, 4 * words, words);
 return 0;
 }
 
@@ -437,13 +904,17 @@ return 0;
 
 int d_inlvham(unsigned int plen, FILE *in, FILE *out)
 {
+	plen = plenof(plen);
 	int next = 0;
 	int end = 0;
 	unsigned char c = 0x00;
 	unsigned char buff[7][plen];
+	unsigned long long groups = 0;
 
+	STAT_START(t0);
 	while (!end)
 	{
+		groups++;
 		// for each hamming code position (between packets)
 		for (unsigned int i = 0; i < 7; i++)
 		{
@@ -473,99 +944,722 @@ int d_inlvham(unsigned int plen, FILE *in, FILE *out)
 			}
 		}
 	}
-	printf("finished deinterleave\n");
+	STAT_STOP(ST_D_INLVHAM, t0, groups * 7 * plen, groups * 7 * plen, groups);
 	return 0;
 }
 
 
 
 
-/*---*/
+/* Hamming 7,4 on buffers
+ *
+ * Same code and layout as h74/d_h74, for callers that already have the
+ * data in memory (the pipeline, mapped files). Decoding matches the
+ * syndrome against the decoder matrix for all 8 bit positions at once
+ * with masks, instead of d_h74's search.
+ */
+
+// Correct one group of 7 codeword bytes in place.
+// returns the bit positions that needed fixing
+static inline unsigned char h74_fix(unsigned char *c)
+{
+	unsigned char s0 = c[0] ^ c[1] ^ c[3] ^ c[4];
+	unsigned char s1 = c[0] ^ c[2] ^ c[3] ^ c[5];
+	unsigned char s2 = c[1] ^ c[2] ^ c[3] ^ c[6];
+
+	c[0] ^= s0 & s1 & ~s2;	// 110
+	c[1] ^= s0 & ~s1 & s2;	// 101
+	c[2] ^= ~s0 & s1 & s2;	// 011
+	c[3] ^= s0 & s1 & s2;	// 111
+#ifdef FEC_STATS
+	STAT_ADD(h74fix[0], __builtin_popcount(s0 & s1 & ~s2 & 0xff));
+	STAT_ADD(h74fix[1], __builtin_popcount(s0 & ~s1 & s2 & 0xff));
+	STAT_ADD(h74fix[2], __builtin_popcount(~s0 & s1 & s2 & 0xff));
+	STAT_ADD(h74fix[3], __builtin_popcount(s0 & s1 & s2));
+	STAT_ADD(h74fix[4], __builtin_popcount(s0 & ~s1 & ~s2 & 0xff));
+	STAT_ADD(h74fix[5], __builtin_popcount(~s0 & s1 & ~s2 & 0xff));
+	STAT_ADD(h74fix[6], __builtin_popcount(~s0 & ~s1 & s2 & 0xff));
+#endif
+	return s0 | s1 | s2;
+}
+
+// len bytes in, 7 bytes out per 4 in (the last group padded with 0s)
+// returns bytes written
+size_t h74blk_enc(const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t o = 0;
+	for (size_t i = 0; i < len; i += 4, o += 7)
+	{
+		unsigned char c[4] = { 0, 0, 0, 0 };
+		memcpy(c, in + i, len - i < 4 ? len - i : 4);
+		out[o] = c[0];
+		out[o+1] = c[1];
+		out[o+2] = c[2];
+		out[o+3] = c[3];
+		out[o+4] = c[0] ^ c[1] ^ c[3];
+		out[o+5] = c[0] ^ c[2] ^ c[3];
+		out[o+6] = c[1] ^ c[2] ^ c[3];
+	}
+	return o;
+}
+
+// len codeword bytes in (whole groups of 7), 4 bytes out per group
+// returns bytes written
+size_t h74blk_dec(const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t o = 0;
+	for (size_t i = 0; i + 7 <= len; i += 7, o += 4)
+	{
+		unsigned char c[7];
+		memcpy(c, in + i, 7);
+		h74_fix(c);
+		memcpy(out + o, c, 4);
+	}
+	return o;
+}
 
 
 
 
-/* REED SOLOMON FUNCTIONS */
+/* Nibble Hamming (7,4)
+ *
+ * The conventional layout, for comparison with h74: each 4 bit nibble
+ * becomes one codeword byte, so a bad byte only ever hits one codeword.
+ *
+ *   bits 0-3: d1 d2 d3 d4 (the nibble)
+ *   bits 4-6: p1 p2 p3, same equations as h74's c5 c6 c7
+ *   bit 7:    0, or with secded, parity of bits 0-6 (extended (8,4)
+ *             code: fixes one bad bit, detects two)
+ *
+ * Both directions are table lookups, 8 codeword bytes per step, with no
+ * branches unless a codeword needed fixing.
+ */
 
-// Helper function: Galois Field multiplication
+static unsigned char hn_enc[2][16];
+// decoded nibble | HN_FIXED or HN_BAD
+static unsigned char hn_dec[2][256];
+// bit flipped to fix the codeword, for stats
+static signed char hn_pos[2][256];
+static int hn_ready = 0;
 
-// Naturally, I made this without realizing log multiplicaiton is more efficient.
-// If encoding resources becomes a problem, definitely use log multiplication instead.
+#define HN_FIXED 0x10
+#define HN_BAD   0x20
 
-unsigned char mulGF(unsigned char poly1, unsigned char poly2, unsigned short power, unsigned short generator)
+static void hn_init(void)
 {
-	// result will be temporarily larger than a char
-	unsigned short p1 = (unsigned short) poly1;
-	unsigned short p2 = (unsigned short) poly2;
-	unsigned short result = 0;
-	unsigned short mask;
-	unsigned short gen = generator;
-
-	/* Expanded multiplication with mod_2 addition */
-	for (int i = 0; i < power; i++)
+	if (hn_ready)
+		return;
+	for (int d = 0; d < 16; d++)
 	{
-		if (p2 & 0x01)
+		int d1 = d & 1, d2 = (d >> 1) & 1, d3 = (d >> 2) & 1, d4 = (d >> 3) & 1;
+		int c = d | (d1 ^ d2 ^ d4) << 4 | (d1 ^ d3 ^ d4) << 5 | (d2 ^ d3 ^ d4) << 6;
+		hn_enc[0][d] = (unsigned char) c;
+		hn_enc[1][d] = (unsigned char) (c | __builtin_parity(c) << 7);
+	}
+	// nearest codeword to every possible byte
+	for (int sec = 0; sec < 2; sec++)
+	{
+		for (int x = 0; x < 256; x++)
 		{
-			result ^= p1;
+			int best = 0, bestd = 9, ties = 0;
+			int y = sec ? x : x & 0x7f;
+			for (int d = 0; d < 16; d++)
+			{
+				int dist = __builtin_popcount(y ^ hn_enc[sec][d]);
+				if (dist < bestd)
+				{
+					best = d;
+					bestd = dist;
+					ties = 0;
+				}
+				else if (dist == bestd)
+					ties++;
+			}
+			hn_pos[sec][x] = -1;
+			if (bestd == 0)
+				hn_dec[sec][x] = (unsigned char) best;
+			else if (bestd == 1 && !ties)
+			{
+				hn_dec[sec][x] = (unsigned char) (best | HN_FIXED);
+				hn_pos[sec][x] = (signed char) __builtin_ctz(y ^ hn_enc[sec][best]);
+			}
+			else // two bits wrong: leave the data as received
+				hn_dec[sec][x] = (unsigned char) ((x & 0x0f) | HN_BAD);
 		}
-		p2 >>= 1;
-		p1 <<= 1;
-		if (p2==0) break;
 	}
+	hn_ready = 1;
+}
 
-	/* Reduction over generator */
-	if (gen < result)
-	{ // If result already less than gen, no need
-		return result;
-	}
+// Encode len bytes from in into 2*len codeword bytes in out
+void h74nblk_enc(int secded, const unsigned char *in, size_t len, unsigned char *out)
+{
+	hn_init();
+	const unsigned char *enc = hn_enc[secded != 0];
+	size_t i = 0;
 
-	mask = 0x8000; // one bit set
-	// 16 bits in unsigned short minus 9 bits for gen
-	while (!(mask&result))
+	// 4 bytes in, one 64 bit word out
+	for (; i + 4 <= len; i += 4)
 	{
-		mask >>= 1;
-		printf("1 result %x mask %x\n",result,mask);
-		if (mask == 0) break;
+		uint64_t w = 0;
+		for (int b = 0; b < 4; b++)
+		{
+			w |= (uint64_t) enc[in[i+b] & 0x0f] << (16 * b);
+			w |= (uint64_t) enc[in[i+b] >> 4] << (16 * b + 8);
+		}
+		// w is little endian codeword order
+		for (int b = 0; b < 8; b++)
+			out[2*i + b] = (unsigned char) (w >> (8 * b));
 	}
+	for (; i < len; i++)
+	{
+		out[2*i] = enc[in[i] & 0x0f];
+		out[2*i + 1] = enc[in[i] >> 4];
+	}
+}
 
-	// Because bit-shifting right is compiler-dependent,
-	// shift is used to re-shift from the right instead.
-
-	// ... these are all unsigned so most likely the compiler will be fine.
-
-	// Repeated subtraction (xor) in long division:
-//	gen <<= shift; // gen should already be 9 bits
-	gen *= mask;
-	while (2^power >= result)
+// Decode len codeword bytes from in into len/2 bytes in out
+// returns number of codewords with two bad bits (secded only)
+int h74nblk_dec(int secded, const unsigned char *in, size_t len, unsigned char *out)
+{
+	hn_init();
+	int sec = secded != 0;
+	const unsigned char *dec = hn_dec[sec];
+	int bad = 0;
+	size_t i = 0;
+
+	len &= ~(size_t) 1;
+	// byte by byte, so the order is the same whatever the host
+	for (; i + 8 <= len; i += 8)
 	{
-		if (mask & result)
+		unsigned char flags = 0;
+		for (int b = 0; b < 4; b++)
 		{
-			result ^= gen;
+			unsigned char lo = dec[in[i + 2*b]];
+			unsigned char hi = dec[in[i + 2*b + 1]];
+			out[i/2 + b] = (unsigned char) ((lo & 0x0f) | hi << 4);
+			flags |= lo | hi;
+		}
+		if (flags & (HN_FIXED | HN_BAD))
+		{	// rare: count what happened
+			for (int b = 0; b < 8; b++)
+			{
+				unsigned char x = in[i + b];
+				if (dec[x] & HN_BAD)
+					bad++;
+				else if (dec[x] & HN_FIXED)
+					STAT_ADD(h74nfix[hn_pos[sec][x]], 1);
+			}
 		}
-		mask >>= 1;
-		gen >>= 1;
-		printf("2 gen %x mask %x result %x\n",gen,mask,result);
-		if (mask == 0) break;
 	}
-	return result;
+	for (; i < len; i += 2)
+	{
+		unsigned char lo = dec[in[i]];
+		unsigned char hi = dec[in[i+1]];
+		out[i/2] = (unsigned char) ((lo & 0x0f) | hi << 4);
+		bad += ((lo & HN_BAD) != 0) + ((hi & HN_BAD) != 0);
+		if (lo & HN_FIXED)
+			STAT_ADD(h74nfix[hn_pos[sec][in[i]]], 1);
+		if (hi & HN_FIXED)
+			STAT_ADD(h74nfix[hn_pos[sec][in[i+1]]], 1);
+	}
+	STAT_ADD(h74nbad, bad);
+	return bad;
 }
 
+// Encode nibble hamming 7,4 (secded: extended 8,4)
+int h74n(int secded, FILE *in, FILE *out)
+{
+	unsigned char buf[4096];
+	unsigned char cw[8192];
+	size_t got;
+	unsigned long long total = 0;
+
+	STAT_START(t0);
+	while ((got = fread(buf, 1, sizeof(buf), in)) > 0)
+	{
+		h74nblk_enc(secded, buf, got, cw);
+		fwrite(cw, 1, 2 * got, out);
+		total += got;
+	}
+	STAT_STOP(ST_H74N, t0, total, 2 * total, 2 * total);
+	return 0;
+}
 
+// Decode nibble hamming 7,4
+// returns number of codewords found with two bad bits (secded only)
+int d_h74n(int secded, FILE *in, FILE *out)
+{
+	unsigned char cw[8192];
+	unsigned char buf[4096];
+	size_t got;
+	int bad = 0;
+	unsigned long long total = 0;
+
+	STAT_START(t0);
+	while ((got = fread(cw, 1, sizeof(cw), in)) > 0)
+	{
+		bad += h74nblk_dec(secded, cw, got, buf);
+		fwrite(buf, 1, got / 2, out);
+		total += got;
+	}
+	STAT_STOP(ST_D_H74N, t0, total, total / 2, total);
+	return bad;
+}
 
 
 
-// Reed-Solomon Encoder
-// BCH perspective
 
-//Eventually this will become a generic function for RS
+/* Bit interleaver
+ *
+ * h74 uses the 8 bits of a byte as 8 separate codes, and codewords are
+ * 7 bytes in a row, so a burst inside one byte lands in one codeword
+ * group. This spreads the bits of each packet out first.
+ *
+ * Each packet is cut into blocks of 8*depth bytes, seen as 8 rows of
+ * depth bytes. Output byte 8q+j holds bit j of the bytes in column q
+ * (bytes q, q+depth, ..., q+7*depth). A bad byte on the link then hits
+ * 8 bytes depth apart, all in the same bit position, and a longer burst
+ * hits other bit positions of those same bytes - which h74 treats as
+ * separate codes. With depth >= 7 no codeword gets more than one bit.
+ * Bytes that don't make up a whole block at the end of a packet are
+ * sent as is.
+ *
+ * Each column is an 8x8 bit matrix transpose, done on a 64 bit word
+ * with three swap steps.
+ */
 
-// n,k: 2,1
-// packet size: p
-// code word size: 1 byte (GF(2^8))
-int rs2x1(int p, FILE *in, FILE *out)
+static inline uint64_t transpose8(uint64_t x)
 {
+	uint64_t t;
+	t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaull;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000cccc0000ccccull;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ull;
+	x ^= t ^ (t << 28);
+	return x;
+}
 
-// matrix:
+// Interleave one packet of len bytes
+void bilvblk(unsigned int depth, const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t blen = (size_t) 8 * depth;
+	size_t i = 0;
+
+	for (; i + blen <= len; i += blen)
+	{
+		const unsigned char *src = in + i;
+		unsigned char *dst = out + i;
+		for (unsigned int q = 0; q < depth; q++)
+		{
+			uint64_t x = 0;
+			for (int r = 0; r < 8; r++)
+				x |= (uint64_t) src[r * depth + q] << (8 * r);
+			x = transpose8(x);
+			for (int j = 0; j < 8; j++)
+				dst[8 * q + j] = (unsigned char) (x >> (8 * j));
+		}
+	}
+	memcpy(out + i, in + i, len - i);
+}
+
+// De-interleave one packet of len bytes
+void d_bilvblk(unsigned int depth, const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t blen = (size_t) 8 * depth;
+	size_t i = 0;
+
+	for (; i + blen <= len; i += blen)
+	{
+		const unsigned char *src = in + i;
+		unsigned char *dst = out + i;
+		for (unsigned int q = 0; q < depth; q++)
+		{
+			uint64_t x = 0;
+			for (int j = 0; j < 8; j++)
+				x |= (uint64_t) src[8 * q + j] << (8 * j);
+			x = transpose8(x);
+			for (int r = 0; r < 8; r++)
+				dst[r * depth + q] = (unsigned char) (x >> (8 * r));
+		}
+	}
+	memcpy(out + i, in + i, len - i);
+}
+
+// bit interleave each packet of plen bytes
+// returns number of packets
+static int bilvstream(int dir, unsigned int depth, unsigned int plen, FILE *in, FILE *out)
+{
+	if (depth < 1 || plen == 0 || plen > 65535)
+		return -1;
+
+	unsigned char packet[plen];
+	unsigned char buf[plen];
+	int pcount = 0;
+	size_t got;
+
+	STAT_START(t0);
+	while ((got = fread(packet, 1, plen, in)) > 0)
+	{
+		memset(packet + got, 0, plen - got);
+		if (dir)
+			d_bilvblk(depth, packet, plen, buf);
+		else
+			bilvblk(depth, packet, plen, buf);
+		fwrite(buf, 1, plen, out);
+		pcount++;
+		if (got < plen)
+			break;
+	}
+	STAT_STOP(dir ? ST_D_BILV : ST_BILV, t0, (unsigned long long) pcount * plen,
+		(unsigned long long) pcount * plen, pcount);
+	return pcount;
+}
+
+int bilv(unsigned int depth, unsigned int plen, FILE *in, FILE *out)
+{
+	return bilvstream(0, depth, plenof(plen), in, out);
+}
+
+int d_bilv(unsigned int depth, unsigned int plen, FILE *in, FILE *out)
+{
+	return bilvstream(1, depth, plenof(plen), in, out);
+}
+
+
+
+
+/* PROTECTED HEADER */
+
+/* A second header inside the UDP payload that survives bit errors, for
+ * receivers that see every frame (raw capture) rather than only what
+ * the adapter lets through:
+ *
+ *   UDP header           8 bytes, length = plen + 12
+ *   sync word            1A CF FC 1D (the CCSDS ASM)
+ *   seq, len             16 bits each, little endian, extended
+ *                        Hamming (8,4): 8 bytes, one bad bit per byte
+ *                        fixed, two found
+ *   payload              plen bytes, the first len of them data
+ *
+ * decUDPx finds frames by the sync word (allowing a few bad bits), so
+ * it doesn't care what happened to the UDP header, and puts payloads in
+ * place by seq, so a frame missing from the capture costs one packet
+ * instead of the alignment of everything after it.
+ */
+
+#define PH_LEN		12	// sync + coded seq, len
+#define PH_SYNC		0x1dfccf1a	// 1A CF FC 1D read little endian
+#define PH_SYNCTOL	3	// bad sync bits still taken as sync
+#define PH_MAXGAP	4096	// a bigger jump in seq is a bad seq
+
+static inline uint32_t ph_sync(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static inline int ph_issync(const unsigned char *p)
+{
+	return __builtin_popcount(ph_sync(p) ^ PH_SYNC) <= PH_SYNCTOL;
+}
+
+// Whole of in into memory
+static unsigned char *slurp(FILE *in, size_t *size)
+{
+	size_t cap = 1 << 16;
+	unsigned char *buf = malloc(cap);
+
+	*size = 0;
+	while (buf != NULL)
+	{
+		*size += fread(buf + *size, 1, cap - *size, in);
+		if (*size < cap)
+			break;
+		unsigned char *nb = realloc(buf, 2 * cap);
+		if (nb == NULL)
+			free(buf);
+		buf = nb;
+		cap *= 2;
+	}
+	return buf;
+}
+
+// Sync word and coded seq, len for packet seq
+static void ph_frame(unsigned char *frame, unsigned int seq, unsigned int len)
+{
+	unsigned char f[4] = { (unsigned char) seq, (unsigned char) (seq >> 8),
+		(unsigned char) len, (unsigned char) (len >> 8) };
+	frame[0] = 0x1a;
+	frame[1] = 0xcf;
+	frame[2] = 0xfc;
+	frame[3] = 0x1d;
+	h74nblk_enc(1, f, 4, frame + 4);
+}
+
+// Like inlvUDP, with the protected header. The last packet is short
+// (maybe 0 bytes of data) and marks the end.
+// returns number of packets
+int inlvUDPx(unsigned int plen, FILE *in, FILE *out)
+{
+	plen = plenof(plen);
+	if (plen < 1 || plen + PH_LEN > 65535)
+		return -1;
+	hn_init();
+
+	unsigned char frame[PH_LEN + plen];
+	unsigned char *payload = frame + PH_LEN;
+	int pcount = 0;
+	size_t got;
+
+	STAT_START(t0);
+	do
+	{
+		got = fread(payload, 1, plen, in);
+		memset(payload + got, 0, plen - got);
+		ph_frame(frame, (unsigned int) pcount, (unsigned int) got);
+		addUDP(plen + PH_LEN, out);
+		fwrite(frame, 1, PH_LEN + plen, out);
+		pcount++;
+	} while (got == plen);
+	STAT_STOP(ST_UDPX, t0, (unsigned long long) pcount * plen,
+		(unsigned long long) pcount * (plen + PH_LEN + 8), pcount);
+	return pcount;
+}
+
+// Would the adapter drop this frame for its UDP header?
+static int ph_udpbad(const unsigned char *f, unsigned int plen)
+{
+	return f[2] != 0xff || f[3] != 0xff || f[4] != (unsigned char) (plen + PH_LEN)
+		|| f[5] != (unsigned char) ((plen + PH_LEN) >> 8) || f[6] || f[7];
+}
+
+// Walks a raw capture of inlvUDPx frames in order of seq
+struct phscan {
+	const unsigned char *buf;
+	size_t size, pos;
+	unsigned int plen, flen;
+	long next;		// seq expected next
+	int end;		// the short last packet has been seen
+};
+
+static void ph_start(struct phscan *s, const unsigned char *buf, size_t size, unsigned int plen)
+{
+	s->buf = buf;
+	s->size = size;
+	s->pos = 0;
+	s->plen = plen;
+	s->flen = plen + PH_LEN + 8;
+	s->next = 0;
+	s->end = 0;
+}
+
+// Next frame, found by sync word and seq: its offset in the capture
+// (UDP header first; the frame may be cut off by the end of it), its
+// full seq (never less than the seq after the last one), its data
+// length, and how damaged its headers are (bad sync bits, plus 1 for a
+// UDP header the adapter would drop, plus 8 for a seq or len that
+// didn't decode).
+// returns 0 at the end of the capture
+static int ph_scan(struct phscan *s, size_t *at, long *seq, unsigned int *len, int *dmg)
+{
+	while (!s->end && s->pos + 8 + PH_LEN <= s->size)
+	{
+		const unsigned char *f = s->buf + s->pos;
+		unsigned char h[4];
+		int badseq = h74nblk_dec(1, f + 12, 4, h);
+		int badlen = h74nblk_dec(1, f + 16, 4, h + 2);
+		unsigned int sq = h[0] | h[1] << 8;
+		unsigned int ln = h[2] | h[3] << 8;
+
+		if (!ph_issync(f + 8) && !(badseq == 0 && sq == (s->next & 0xffff)))
+		{	// lost our place: find the next sync word
+			size_t q = s->pos + 1;
+			while (q + 8 + PH_LEN <= s->size && q < s->pos + 2 * s->flen
+				&& !ph_issync(s->buf + q + 8))
+				q++;
+			if (q + 8 + PH_LEN <= s->size && q < s->pos + 2 * s->flen)
+				s->pos = q;
+			else
+				s->pos += s->flen;
+			continue;
+		}
+
+		// what doesn't decode, guess: the packet after the last one
+		long full = s->next;
+		if (badseq == 0)
+		{
+			full = s->next + (int16_t) (sq - (unsigned int) (s->next & 0xffff));
+			if (full < s->next - PH_MAXGAP || full > s->next + PH_MAXGAP)
+				full = s->next;
+		}
+		if (full < s->next)
+		{	// already have it
+			s->pos += s->flen;
+			continue;
+		}
+		if (badlen != 0 || ln > s->plen)
+			ln = s->plen;
+		else if (ln < s->plen)
+			s->end = 1;
+
+		*at = s->pos;
+		*seq = full;
+		*len = ln;
+		*dmg = __builtin_popcount(ph_sync(f + 8) ^ PH_SYNC)
+			+ ph_udpbad(f, s->plen)
+			+ 8 * (badseq != 0 || badlen != 0);
+		s->next = full + 1;
+		s->pos += s->flen;
+		return 1;
+	}
+	return 0;
+}
+
+// Raw capture receiver for inlvUDPx. Frames are taken by sync word and
+// seq, whatever their UDP header says. Packets that never turn up are
+// written as plen 0s and, if eras is not NULL, flagged in eras (up to
+// maxp entries) for the erasure decoders.
+// returns number of packets written, or -1
+long decUDPx(unsigned int plen, unsigned char *eras, long maxp, FILE *in, FILE *out)
+{
+	plen = plenof(plen);
+	if (plen < 1 || plen + PH_LEN > 65535)
+		return -1;
+	hn_init();
+
+	// the whole capture, so a lost sync can be searched for
+	size_t size;
+	unsigned char *buf = slurp(in, &size);
+	if (buf == NULL)
+		return -1;
+
+	unsigned char *zero = calloc(1, plen);
+	long next = 0;		// packets written
+	struct phscan s;
+	size_t at;
+	long seq;
+	unsigned int len;
+	int dmg;
+
+	if (zero == NULL)
+	{
+		free(buf);
+		return -1;
+	}
+	ph_start(&s, buf, size, plen);
+	STAT_START(t0);
+	while (ph_scan(&s, &at, &seq, &len, &dmg))
+	{
+		for (; next < seq; next++)
+		{
+			fwrite(zero, 1, plen, out);
+			if (eras != NULL && next < maxp)
+				eras[next] = 1;
+		}
+		size_t have = size - (at + 8 + PH_LEN);
+		if (have > len)
+			have = len;
+		fwrite(buf + at + 8 + PH_LEN, 1, have, out);
+		fwrite(zero, 1, len - have, out);
+		if (eras != NULL && next < maxp)
+			eras[next] = 0;
+
+		if (ph_udpbad(buf + at, plen))
+			STAT_ADD(salvaged, 1);
+		next++;
+	}
+	STAT_STOP(ST_D_UDPX, t0, size, (unsigned long long) next * plen, next);
+	free(zero);
+	free(buf);
+	return next;
+}
+
+
+
+/*---*/
+
+
+
+
+/* REED SOLOMON FUNCTIONS */
+
+// Helper function: Galois Field multiplication
+
+// Naturally, I made this without realizing log multiplicaiton is more efficient.
+// If encoding resources becomes a problem, definitely use log multiplication instead.
+
+unsigned char mulGF(unsigned char poly1, unsigned char poly2, unsigned short power, unsigned short generator)
+{
+	// result will be temporarily larger than a char
+	unsigned short p1 = (unsigned short) poly1;
+	unsigned short p2 = (unsigned short) poly2;
+	unsigned short result = 0;
+	unsigned short mask;
+	unsigned short gen = generator;
+
+	/* Expanded multiplication with mod_2 addition */
+	for (int i = 0; i < power; i++)
+	{
+		if (p2 & 0x01)
+		{
+			result ^= p1;
+		}
+		p2 >>= 1;
+		p1 <<= 1;
+		if (p2==0) break;
+	}
+
+	/* Reduction over generator */
+	if (gen < result)
+	{ // If result already less than gen, no need
+		return result;
+	}
+
+	mask = 0x8000; // one bit set
+	// 16 bits in unsigned short minus 9 bits for gen
+	while (!(mask&result))
+	{
+		mask >>= 1;
+		if (mask == 0) break;
+	}
+
+	// Because bit-shifting right is compiler-dependent,
+	// shift is used to re-shift from the right instead.
+
+	// ... these are all unsigned so most likely the compiler will be fine.
+
+	// Repeated subtraction (xor) in long division:
+//	gen <<= shift; // gen should already be 9 bits
+	gen *= mask;
+	while (2^power >= result)
+	{
+		if (mask & result)
+		{
+			result ^= gen;
+		}
+		mask >>= 1;
+		gen >>= 1;
+		if (mask == 0) break;
+	}
+	return result;
+}
+
+
+
+
+
+// Reed-Solomon Encoder
+// BCH perspective
+
+//Eventually this will become a generic function for RS
+
+// n,k: 2,1
+// packet size: p
+// code word size: 1 byte (GF(2^8))
+int rs2x1(int p, FILE *in, FILE *out)
+{
+
+// matrix:
 // [n+k] x [n]
 
 /*
@@ -614,6 +1708,7 @@ vand[2][1] = 0x01
 	unsigned char packet[n+k][p];
 	int end = 0;
 
+	STAT_START(t0);
 	while (!end)
 	{	// For every group of bytes about to be a original message packet
 		for (int i = 0; i < n; i++)
@@ -657,6 +1752,8 @@ vand[2][1] = 0x01
 		}
 		counter++;
 	}
+	STAT_STOP(ST_RS2X1, t0, (unsigned long long) counter * n * p,
+		(unsigned long long) counter * (n + k) * p, counter);
 	return counter;
 }
 
@@ -671,8 +1768,10 @@ vand[2][1] = 0x01
 // and "not received" packets are actually all 0s. (see udp decoder)
 
 // plen = packet length, bytes. pnum = number of packets including parity
-int d_rs2x1(unsigned int plen, int pnum, FILE *in, FILE *out)
+// eras = NULL, or one flag per packet (nonzero = erased, see decUDPcrc)
+int d_rs2x1e(unsigned int plen, int pnum, const unsigned char *eras, FILE *in, FILE *out)
 {
+	plen = plenof(plen);
 
 	// Once again, some parts are hardcoded, others depend on n,k being 2,1
 	int n = 2;
@@ -681,6 +1780,8 @@ int d_rs2x1(unsigned int plen, int pnum, FILE *in, FILE *out)
 	unsigned char packet[pnum][plen]; // saves all packets at once (make this better?)
 	int superzip[pnum]; // tracks if the packet is all zeroes
 
+	STAT_START(t0);
+
 	// for each packet
 	for (int i = 0; i < pnum; i++)
 	{
@@ -703,12 +1804,14 @@ int d_rs2x1(unsigned int plen, int pnum, FILE *in, FILE *out)
 		{	// superzip being 0 => all bytes are 0
 			superzip[i] |= packet[i][j3];
 		}
+		// if we know better, a lost packet counts as all 0s
+		if (eras != NULL)
+			superzip[i] = !eras[i];
 	}
 
 	// for each packet group
 	for (int i = 0; i < pnum; i+= n+k)
 	{
-		printf("%d %d %d\n",(unsigned short) superzip[0+i],(unsigned short) superzip[1+i],(unsigned short) superzip[2+i]);
 		// if first packet is 0s, decode with 2nd and 3rd, if correct
 		// decoder matrix for 2,1: [(1,0),(1,1)]
 		if (superzip[0+i] == 0x00 && superzip[2+i] != 0x00)
@@ -723,7 +1826,7 @@ int d_rs2x1(unsigned int plen, int pnum, FILE *in, FILE *out)
 			{	// then write second packet
 				fputc(packet[1+i][j2],out);
 			}
-		printf("packet 1 all 0s, packet 3 not\n");
+		STAT_ADD(rsfix, 1); // packet 1 all 0s, packet 3 not
 		}
 		// if first isn't all 0s, see if 2nd is, and change if 3rd is correct
 		// decoder matrix: same for 2,1
@@ -738,7 +1841,7 @@ int d_rs2x1(unsigned int plen, int pnum, FILE *in, FILE *out)
 				unsigned char adjusted = packet[0+i][j2] ^ packet[2+i][j2];
 				fputc(adjusted,out);
 			}
-		printf("packet 2 all 0s, packet 3 not\n");
+		STAT_ADD(rsfix, 1); // packet 2 all 0s, packet 3 not
 		}
 
 		// if neither are, or if 3rd is incorrect, use first two packets (no berlkamf 4u)
@@ -752,62 +1855,4620 @@ int d_rs2x1(unsigned int plen, int pnum, FILE *in, FILE *out)
 			{
 				fputc(packet[1+i][j2],out);
 			}
-		printf("else\n");
-
 		}
 	}
 
+	STAT_STOP(ST_D_RS2X1, t0, (unsigned long long) pnum * plen,
+		(unsigned long long) (pnum / (n + k)) * n * plen, pnum / (n + k));
 	return 0;
 }
 
+// As above, guessing lost packets from them being all 0s
+int d_rs2x1(unsigned int plen, int pnum, FILE *in, FILE *out)
+{
+	return d_rs2x1e(plen, pnum, NULL, in, out);
+}
+
 
-/* DATA SCRAMBLING FUNCTIONS
- * to aid in testing
+/* GALOIS FIELD TABLES */
+
+// Log/antilog tables for GF(2^8), same generator as rs2x1 (285).
+// This is the log multiplication mentioned above mulGF.
+// gf_exp is doubled so gf_exp[log a + log b] never needs a mod 255.
+
+static unsigned char gf_exp[512];
+static unsigned char gf_log[256];
+// c times each low nibble, and c times each high nibble (for gfv_mulc)
+static unsigned char gf_nlo[256][16];
+static unsigned char gf_nhi[256][16];
+static int gf_ready = 0;
+
+static void gf_init(void)
+{
+	if (gf_ready)
+		return;
+	unsigned short x = 1;
+	for (int i = 0; i < 255; i++)
+	{
+		gf_exp[i] = (unsigned char) x;
+		gf_log[x] = (unsigned char) i;
+		x <<= 1;
+		if (x & 0x100)
+			x ^= 285;
+	}
+	for (int i = 255; i < 512; i++)
+		gf_exp[i] = gf_exp[i - 255];
+	for (int c = 1; c < 256; c++)
+	{
+		for (int x = 0; x < 16; x++)
+		{
+			unsigned char lo = (unsigned char) x;
+			unsigned char hi = (unsigned char) (x << 4);
+			gf_nlo[c][x] = lo ? gf_exp[gf_log[c] + gf_log[lo]] : 0;
+			gf_nhi[c][x] = hi ? gf_exp[gf_log[c] + gf_log[hi]] : 0;
+		}
+	}
+	gf_ready = 1;
+}
+
+static inline unsigned char gf_mul(unsigned char a, unsigned char b)
+{
+	if (a == 0 || b == 0)
+		return 0;
+	return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+// a must not be 0
+static inline unsigned char gf_inv(unsigned char a)
+{
+	return gf_exp[255 - gf_log[a]];
+}
+
+// Fill row with c*x for every x, so a whole packet can be multiplied
+// by a constant with one table lookup per byte.
+static void gf_mulrow(unsigned char c, unsigned char row[256])
+{
+	row[0] = 0;
+	for (int x = 1; x < 256; x++)
+		row[x] = gf_mul(c, (unsigned char) x);
+}
+
+
+
+// 16 symbols at a time
+
+/* gfv holds one symbol from each of 16 codewords, so the same constant
+ * multiply can be done to all of them at once. With SSSE3 the multiply
+ * is two pshufb lookups (c * low nibble ^ c * high nibble); otherwise
+ * it falls back to the log tables one byte at a time.
  */
 
+#define GFV_LANES 16
 
+#ifdef __SSSE3__
 
-// Stratified scramble
-// Every n bytes, the read char will be XORed with 0xff.
+typedef __m128i gfv;
 
-void sstrat(int n, FILE *in, FILE *out)
+static inline gfv gfv_load(const unsigned char *p)
 {
-        int end = 0;
-        while (!end)
-        {
-                int c, alt;
-                for (int i = 0; i < n-1 && !end; i++)
-                {
-                        c = fgetc(in);
-                        if (c==EOF)
-                                end = 1;
-                        else
-                                fputc((unsigned char) c,out);
-                }
-                alt = fgetc(in);
-                if (alt==EOF)
-                        break;
-                else
-                {
-                        unsigned char temp = ((unsigned char) alt) ^ 0xff;
-                        fputc(temp,out);
-                }
-        }
-        return;
+	return _mm_loadu_si128((const __m128i *) p);
 }
 
-// scrambles by &&ing with a random number a power of 2 times
-// 1 in 2^n chance of any bit being flipped
-void scram(int n, FILE *in, FILE *out)
+static inline void gfv_store(unsigned char *p, gfv v)
 {
-  int end = 0;
-  int next = 0;
-  srand(time(0));
+	_mm_storeu_si128((__m128i *) p, v);
+}
 
-  while ((next=fgetc(in)) != EOF)
-  {
-    unsigned char c = (unsigned char) next;
-    unsigned char flip = 0xff;
+static inline gfv gfv_zero(void)
+{
+	return _mm_setzero_si128();
+}
+
+static inline gfv gfv_xor(gfv a, gfv b)
+{
+	return _mm_xor_si128(a, b);
+}
+
+static inline gfv gfv_mulc(gfv x, unsigned char c)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	__m128i lo = _mm_loadu_si128((const __m128i *) gf_nlo[c]);
+	__m128i hi = _mm_loadu_si128((const __m128i *) gf_nhi[c]);
+	return _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(x, mask)),
+		_mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+}
+
+// bit i set if lane i is 0
+static inline int gfv_zeros(gfv x)
+{
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128()));
+}
+
+#else
+
+typedef struct { unsigned char b[GFV_LANES]; } gfv;
+
+static inline gfv gfv_load(const unsigned char *p)
+{
+	gfv v;
+	memcpy(v.b, p, GFV_LANES);
+	return v;
+}
+
+static inline void gfv_store(unsigned char *p, gfv v)
+{
+	memcpy(p, v.b, GFV_LANES);
+}
+
+static inline gfv gfv_zero(void)
+{
+	gfv v = { { 0 } };
+	return v;
+}
+
+static inline gfv gfv_xor(gfv a, gfv b)
+{
+	for (int i = 0; i < GFV_LANES; i++)
+		a.b[i] ^= b.b[i];
+	return a;
+}
+
+static inline gfv gfv_mulc(gfv x, unsigned char c)
+{
+	for (int i = 0; i < GFV_LANES; i++)
+		x.b[i] = gf_mul(c, x.b[i]);
+	return x;
+}
+
+static inline int gfv_zeros(gfv x)
+{
+	int z = 0;
+	for (int i = 0; i < GFV_LANES; i++)
+		if (x.b[i] == 0)
+			z |= 1 << i;
+	return z;
+}
+
+#endif
+
+
+// Reed-Solomon (k,m) erasure code across packets
+
+// Generalizes rs2x1: every group is k data packets followed by m parity
+// packets, and any k of the k+m packets are enough to rebuild the data.
+// The parity rows come from a Cauchy matrix, which keeps the code
+// systematic and guarantees every k x k submatrix is invertible:
+//
+//	parity[i] = sum over j of data[j] / ((k+i) ^ j)
+//
+// As with rs2x1, packet placement is implied by position in the stream.
+
+static unsigned char rskm_coef(int k, int i, int j)
+{
+	return gf_inv((unsigned char) ((k + i) ^ j));
+}
+
+// groups = number of groups to encode, or 0 to encode until EOF.
+// Encoding a few groups per call lets m change between blocks (see mctrl).
+// returns number of groups written
+int rskm(int k, int m, unsigned int plen, int groups, FILE *in, FILE *out)
+{
+	plen = plenof(plen);
+	if (k < 1 || m < 0 || k + m > 255 || plen == 0 || plen > 65535)
+		return -1;
+	gf_init();
+
+	unsigned char *packet = malloc((size_t) (k + m) * plen);
+	if (packet == NULL)
+		return -1;
+	unsigned char row[256];
+	int counter = 0;
+
+	STAT_START(t0);
+	while (groups <= 0 || counter < groups)
+	{
+		size_t got = fread(packet, 1, (size_t) k * plen, in);
+		if (got == 0)
+			break;
+		// pad the last group with 0s, like the other encoders
+		for (size_t i = got; i < (size_t) k * plen; i++)
+			packet[i] = 0x00;
+
+		// for each parity packet
+		for (int i = 0; i < m; i++)
+		{
+			unsigned char *par = packet + (size_t) (k + i) * plen;
+			for (unsigned int b = 0; b < plen; b++)
+				par[b] = 0x00;
+			// add in each data packet times its coefficient
+			for (int j = 0; j < k; j++)
+			{
+				const unsigned char *dat = packet + (size_t) j * plen;
+				gf_mulrow(rskm_coef(k, i, j), row);
+				for (unsigned int b = 0; b < plen; b++)
+					par[b] ^= row[dat[b]];
+			}
+		}
+		fwrite(packet, 1, (size_t) (k + m) * plen, out);
+		counter++;
+		if (got < (size_t) k * plen)
+			break;
+	}
+	free(packet);
+	STAT_STOP(ST_RSKM, t0, (unsigned long long) counter * k * plen,
+		(unsigned long long) counter * (k + m) * plen, counter);
+	return counter;
+}
+
+// Invert the n x n matrix a (row-major) into inv by Gauss-Jordan elimination.
+// returns -1 if singular (cannot happen for rows taken from rskm's matrix)
+static int gf_invert(unsigned char *a, unsigned char *inv, int n)
+{
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			inv[i*n + j] = (i == j);
+
+	for (int col = 0; col < n; col++)
+	{
+		// find a pivot
+		int piv = col;
+		while (piv < n && a[piv*n + col] == 0)
+			piv++;
+		if (piv == n)
+			return -1;
+		if (piv != col)
+		{
+			for (int j = 0; j < n; j++)
+			{
+				unsigned char t = a[col*n + j];
+				a[col*n + j] = a[piv*n + j];
+				a[piv*n + j] = t;
+				t = inv[col*n + j];
+				inv[col*n + j] = inv[piv*n + j];
+				inv[piv*n + j] = t;
+			}
+		}
+		// scale pivot row to 1
+		unsigned char s = gf_inv(a[col*n + col]);
+		for (int j = 0; j < n; j++)
+		{
+			a[col*n + j] = gf_mul(a[col*n + j], s);
+			inv[col*n + j] = gf_mul(inv[col*n + j], s);
+		}
+		// clear the column everywhere else
+		for (int i = 0; i < n; i++)
+		{
+			unsigned char f = a[i*n + col];
+			if (i == col || f == 0)
+				continue;
+			for (int j = 0; j < n; j++)
+			{
+				a[i*n + j] ^= gf_mul(f, a[col*n + j]);
+				inv[i*n + j] ^= gf_mul(f, inv[col*n + j]);
+			}
+		}
+	}
+	return 0;
+}
+
+// Rebuild the missing data packets of one group in place.
+// lost[i] is nonzero for each erased packet (i < k+m).
+// returns number of packets rebuilt, or -1 if more than m are lost
+static int rskm_fix(int k, int m, unsigned int plen, unsigned char *packet,
+	const unsigned char *lost)
+{
+	int n = k + m;
+	int use[255];
+	int nuse = 0;
+	int missing = 0;
+
+	for (int j = 0; j < k; j++)
+		if (lost[j])
+			missing++;
+	if (missing == 0)
+		return 0;
+
+	// take every data packet we have, then fill up with parity packets
+	for (int i = 0; i < n && nuse < k; i++)
+		if (!lost[i])
+			use[nuse++] = i;
+	if (nuse < k)
+		return -1;
+
+	unsigned char *a = malloc((size_t) 2 * k * k);
+	if (a == NULL)
+		return -1;
+	unsigned char *inv = a + k * k;
+
+	// rows of the encoding matrix for the packets we are using
+	for (int r = 0; r < k; r++)
+		for (int j = 0; j < k; j++)
+		{
+			if (use[r] < k)
+				a[r*k + j] = (use[r] == j);
+			else
+				a[r*k + j] = rskm_coef(k, use[r] - k, j);
+		}
+	if (gf_invert(a, inv, k) < 0)
+	{
+		free(a);
+		return -1;
+	}
+
+	// data[j] = sum over r of inv[j][r] * packet[use[r]]
+	unsigned char row[256];
+	for (int j = 0; j < k; j++)
+	{
+		if (!lost[j])
+			continue;
+		unsigned char *dat = packet + (size_t) j * plen;
+		for (unsigned int b = 0; b < plen; b++)
+			dat[b] = 0x00;
+		for (int r = 0; r < k; r++)
+		{
+			unsigned char c = inv[j*k + r];
+			if (c == 0)
+				continue;
+			const unsigned char *src = packet + (size_t) use[r] * plen;
+			gf_mulrow(c, row);
+			for (unsigned int b = 0; b < plen; b++)
+				dat[b] ^= row[src[b]];
+		}
+	}
+	free(a);
+	return missing;
+}
+
+// Reed-Solomon (k,m) decoder
+
+// pnum = number of packets including parity (as returned by inlvUDP).
+// eras, if not NULL, holds one flag per packet (nonzero = erased); if NULL,
+// packets that are all 0s are taken as dropped, as d_rs2x1 does.
+// Groups with more than m packets lost are written out as received.
+// returns number of data packets recovered
+int d_rskm(int k, int m, unsigned int plen, int pnum,
+	const unsigned char *eras, FILE *in, FILE *out)
+{
+	plen = plenof(plen);
+	if (k < 1 || m < 0 || k + m > 255 || plen == 0 || plen > 65535)
+		return -1;
+	gf_init();
+
+	int n = k + m;
+	unsigned char *packet = malloc((size_t) n * plen);
+	if (packet == NULL)
+		return -1;
+	unsigned char lost[255];
+	int recovered = 0;
+
+	STAT_START(t0);
+
+	// for each packet group
+	for (int g = 0; g < pnum; g += n)
+	{
+		size_t got = fread(packet, 1, (size_t) n * plen, in);
+		for (size_t i = got; i < (size_t) n * plen; i++)
+			packet[i] = 0x00;
+
+		for (int i = 0; i < n; i++)
+		{
+			if (g + i >= pnum)
+				lost[i] = 1;
+			else if (eras != NULL)
+				lost[i] = eras[g + i] != 0;
+			else
+			{
+				// all 0s => dropped by decUDP
+				const unsigned char *p = packet + (size_t) i * plen;
+				unsigned char superzip = 0x00;
+				for (unsigned int b = 0; b < plen; b++)
+					superzip |= p[b];
+				lost[i] = superzip == 0x00;
+			}
+		}
+
+		int fixed = rskm_fix(k, m, plen, packet, lost);
+		if (fixed > 0)
+			recovered += fixed;
+
+		fwrite(packet, 1, (size_t) k * plen, out);
+	}
+	free(packet);
+	STAT_ADD(rsfix, recovered);
+	STAT_STOP(ST_D_RSKM, t0, (unsigned long long) pnum * plen,
+		(unsigned long long) ((pnum + n - 1) / n) * k * plen, (pnum + n - 1) / n);
+	return recovered;
+}
+
+
+
+
+/* Reed-Solomon error and erasure codec */
+
+/* Conventional (BCH view) Reed-Solomon over GF(2^8) with nroots parity
+ * symbols per codeword, generator roots alpha^1 .. alpha^nroots. It fixes
+ * e bad symbols and f erased (known bad) symbols as long as
+ * 2e + f <= nroots, so unlike rskm it also fixes bytes that are wrong in
+ * packets decUDP let through. Shortened codes (n < 255) are the same
+ * code with the missing leading symbols taken as 0.
+ *
+ * Codewords are interleaved like CCSDS does: in a block of depth
+ * codewords, symbol i of codeword c is blk[i*depth + c]. A burst on the
+ * link is spread over depth codewords, and each row of the block is the
+ * same symbol of many codewords, which is what gfv wants.
+ *
+ * Decoding is syndromes (vectorized), Berlekamp-Massey seeded with the
+ * erasures (per codeword, only for codewords with errors), Chien search
+ * (vectorized) and Forney's algorithm.
+ */
+
+// g[0] is the x^nroots coefficient (always 1)
+static void rs_genpoly(int nroots, unsigned char *g)
+{
+	g[0] = 1;
+	for (int i = 1; i <= nroots; i++)
+		g[i] = 0;
+	// multiply in (x + alpha^r) for each root
+	for (int r = 1; r <= nroots; r++)
+		for (int j = r; j > 0; j--)
+			g[j] ^= gf_mul(g[j-1], gf_exp[r]);
+}
+
+// Load nl lanes (nl <= GFV_LANES) of one row; missing lanes read as 0
+static inline gfv rs_load(const unsigned char *p, int nl)
+{
+	unsigned char tmp[GFV_LANES] = { 0 };
+	if (nl == GFV_LANES)
+		return gfv_load(p);
+	memcpy(tmp, p, nl);
+	return gfv_load(tmp);
+}
+
+static inline void rs_store(unsigned char *p, gfv v, int nl)
+{
+	unsigned char tmp[GFV_LANES];
+	if (nl == GFV_LANES)
+	{
+		gfv_store(p, v);
+		return;
+	}
+	gfv_store(tmp, v);
+	memcpy(p, tmp, nl);
+}
+
+// Encode a block of depth codewords of n symbols.
+// Rows 0 .. n-nroots-1 hold the data; the parity goes in the rest.
+void rsblk_enc(int nroots, int n, int depth, unsigned char *blk)
+{
+	if (nroots < 1 || n <= nroots || n > 255 || depth < 1)
+		return;
+	gf_init();
+
+	unsigned char g[256];
+	gfv par[255];
+	int k = n - nroots;
+
+	rs_genpoly(nroots, g);
+
+	// 16 codewords at a time
+	for (int c0 = 0; c0 < depth; c0 += GFV_LANES)
+	{
+		int nl = depth - c0 < GFV_LANES ? depth - c0 : GFV_LANES;
+		for (int j = 0; j < nroots; j++)
+			par[j] = gfv_zero();
+
+		// LFSR division by g(x), one row of data at a time
+		for (int i = 0; i < k; i++)
+		{
+			gfv fb = gfv_xor(rs_load(blk + (size_t) i * depth + c0, nl), par[0]);
+			for (int j = 0; j < nroots - 1; j++)
+				par[j] = gfv_xor(par[j+1], gfv_mulc(fb, g[j+1]));
+			par[nroots-1] = gfv_mulc(fb, g[nroots]);
+		}
+		for (int j = 0; j < nroots; j++)
+			rs_store(blk + (size_t) (k + j) * depth + c0, par[j], nl);
+	}
+}
+
+// Berlekamp-Massey, started from the erasure locator.
+// eras holds erasure locations as powers of alpha.
+// Fills lambda[0..nroots] (lambda[0] = 1) and returns its degree.
+static int rs_bm(int nroots, const unsigned char *s, const int *eras,
+	int neras, unsigned char *lambda)
+{
+	unsigned char b[256], t[256];
+
+	memset(lambda, 0, nroots + 1);
+	lambda[0] = 1;
+	for (int e = 0; e < neras; e++)
+		for (int j = e + 1; j > 0; j--)
+			lambda[j] ^= gf_mul(gf_exp[eras[e]], lambda[j-1]);
+	memcpy(b, lambda, nroots + 1);
+
+	int el = neras;
+	for (int r = neras + 1; r <= nroots; r++)
+	{
+		// discrepancy
+		unsigned char discr = 0;
+		for (int i = 0; i < r; i++)
+			discr ^= gf_mul(lambda[i], s[r-i-1]);
+
+		if (discr == 0)
+		{	// b = x*b
+			memmove(b + 1, b, nroots);
+			b[0] = 0;
+			continue;
+		}
+		t[0] = lambda[0];
+		for (int i = 0; i < nroots; i++)
+			t[i+1] = lambda[i+1] ^ gf_mul(discr, b[i]);
+		if (2 * el <= r + neras - 1)
+		{
+			el = r + neras - el;
+			unsigned char inv = gf_inv(discr);
+			for (int i = 0; i <= nroots; i++)
+				b[i] = gf_mul(lambda[i], inv);
+		}
+		else
+		{
+			memmove(b + 1, b, nroots);
+			b[0] = 0;
+		}
+		memcpy(lambda, t, nroots + 1);
+	}
+
+	int deg = 0;
+	for (int i = 0; i <= nroots; i++)
+		if (lambda[i])
+			deg = i;
+	return deg;
+}
+
+// Forney: error value at location alpha^p (fcr = 1, so no extra X term)
+static int rs_forney(int nroots, const unsigned char *s,
+	const unsigned char *lambda, int deg, int p, unsigned char *err)
+{
+	unsigned char xinv = gf_exp[(255 - p) % 255];
+	unsigned char num = 0, den = 0;
+
+	// omega(x) = s(x) * lambda(x) mod x^nroots, evaluated at X^-1 (Horner)
+	for (int i = nroots - 1; i >= 0; i--)
+	{
+		unsigned char om = 0;
+		for (int j = 0; j <= i && j <= deg; j++)
+			om ^= gf_mul(s[i-j], lambda[j]);
+		num = gf_mul(num, xinv) ^ om;
+	}
+	// formal derivative of lambda: odd terms only
+	for (int j = deg - (deg % 2 == 0); j >= 1; j -= 2)
+		den = gf_mul(den, gf_mul(xinv, xinv)) ^ lambda[j];
+	if (den == 0)
+		return -1;
+	*err = gf_mul(num, gf_inv(den));
+	return 0;
+}
+
+// Decode codewords c0 .. c1-1 of a block (rows depth bytes apart).
+// See rsblk_dec.
+static int rs_decrange(int nroots, int n, int depth, int c0, int c1,
+	unsigned char *blk, const unsigned char *eras, int *res)
+{
+
+	gfv syn[255];
+	gfv term[256];
+	unsigned char s[GFV_LANES][255];
+	unsigned char lambda[GFV_LANES][256];
+	int deg[GFV_LANES];
+	int roots[GFV_LANES][255];
+	int nroot[GFV_LANES];
+	int epos[255];
+	int fails = 0;
+
+	for (; c0 < c1; c0 += GFV_LANES)
+	{
+		int nl = c1 - c0 < GFV_LANES ? c1 - c0 : GFV_LANES;
+		unsigned char tmp[GFV_LANES];
+
+		// syndromes: s_j = r(alpha^(j+1)), Horner over the rows
+		for (int j = 0; j < nroots; j++)
+			syn[j] = gfv_zero();
+		for (int i = 0; i < n; i++)
+		{
+			gfv r = rs_load(blk + (size_t) i * depth + c0, nl);
+			for (int j = 0; j < nroots; j++)
+				syn[j] = gfv_xor(gfv_mulc(syn[j], gf_exp[j+1]), r);
+		}
+
+		// Berlekamp-Massey for each codeword that has errors
+		int active = 0;
+		int maxdeg = 0;
+		for (int j = 0; j < nroots; j++)
+		{
+			gfv_store(tmp, syn[j]);
+			for (int l = 0; l < GFV_LANES; l++)
+				s[l][j] = tmp[l];
+		}
+		for (int l = 0; l < nl; l++)
+		{
+			unsigned char any = 0;
+			for (int j = 0; j < nroots; j++)
+				any |= s[l][j];
+			deg[l] = 0;
+			nroot[l] = 0;
+			if (res)
+				res[c0 + l] = 0;
+			if (any == 0)
+				continue;
+
+			int neras = 0;
+			if (eras != NULL)
+			{
+				for (int i = 0; i < n; i++)
+				{
+					if (!eras[(size_t) i * depth + c0 + l])
+						continue;
+					if (neras == nroots)
+					{
+						neras = nroots + 1;
+						break;
+					}
+					epos[neras++] = n - 1 - i;
+				}
+			}
+			if (neras > nroots)
+				deg[l] = -1;
+			else
+				deg[l] = rs_bm(nroots, s[l], epos, neras, lambda[l]);
+			if (deg[l] <= 0)
+			{	// nothing to search for: can't be corrected
+				deg[l] = -1;
+				continue;
+			}
+			active |= 1 << l;
+			if (deg[l] > maxdeg)
+				maxdeg = deg[l];
+		}
+
+		// Chien search over all active codewords at once:
+		// term j holds lambda_j * alpha^(-j*p) for location p
+		if (active)
+		{
+			for (int j = 0; j <= maxdeg; j++)
+			{
+				for (int l = 0; l < GFV_LANES; l++)
+					tmp[l] = (active & (1 << l)) ? lambda[l][j] : (j == 0);
+				term[j] = gfv_load(tmp);
+			}
+			for (int p = 0; p < n; p++)
+			{
+				gfv sum = term[0];
+				for (int j = 1; j <= maxdeg; j++)
+					sum = gfv_xor(sum, term[j]);
+				int z = gfv_zeros(sum) & active;
+				while (z)
+				{
+					int l = __builtin_ctz(z);
+					z &= z - 1;
+					if (nroot[l] < deg[l])
+						roots[l][nroot[l]] = p;
+					nroot[l]++;
+				}
+				for (int j = 1; j <= maxdeg; j++)
+					term[j] = gfv_mulc(term[j], gf_exp[255 - j]);
+			}
+		}
+
+		// Forney, and fix
+		for (int l = 0; l < nl; l++)
+		{
+			if (deg[l] == 0)
+				continue;
+			int ok = deg[l] > 0 && nroot[l] == deg[l];
+			unsigned char err[255];
+			for (int r = 0; ok && r < nroot[l]; r++)
+				if (rs_forney(nroots, s[l], lambda[l], deg[l], roots[l][r], &err[r]) < 0)
+					ok = 0;
+			if (!ok)
+			{
+				fails++;
+				if (res)
+					res[c0 + l] = -1;
+				continue;
+			}
+			int fixed = 0;
+			for (int r = 0; r < nroot[l]; r++)
+			{
+				int i = n - 1 - roots[l][r];
+				blk[(size_t) i * depth + c0 + l] ^= err[r];
+				fixed += err[r] != 0;
+			}
+			STAT_ADD(rssym, fixed);
+			if (res)
+				res[c0 + l] = fixed;
+		}
+	}
+	STAT_ADD(rsfail, fails);
+	return fails;
+}
+
+// Decode a block of depth codewords of n symbols in place.
+// eras, if not NULL, has one flag per byte of blk (nonzero = known bad).
+// res, if not NULL, gets the number of symbols fixed in each codeword,
+// or -1 if it could not be corrected (and was left as is).
+// returns number of codewords that could not be corrected
+int rsblk_dec(int nroots, int n, int depth, unsigned char *blk,
+	const unsigned char *eras, int *res)
+{
+	if (nroots < 1 || n <= nroots || n > 255 || depth < 1)
+		return -1;
+	gf_init();
+	return rs_decrange(nroots, n, depth, 0, depth, blk, eras, res);
+}
+
+// RS(255,223) stream encoder
+
+// Data is taken in blocks of 223*depth bytes; byte t of a block goes to
+// codeword t % depth, so the data goes out as is, followed by 32 rows of
+// parity. The last block is padded with 0s.
+// returns number of blocks
+int rs255(int depth, FILE *in, FILE *out)
+{
+	if (depth < 1)
+		return -1;
+
+	unsigned char *blk = malloc((size_t) 255 * depth);
+	if (blk == NULL)
+		return -1;
+	size_t dlen = (size_t) 223 * depth;
+	size_t got;
+	int blocks = 0;
+
+	STAT_START(t0);
+	while ((got = fread(blk, 1, dlen, in)) > 0)
+	{
+		memset(blk + got, 0, dlen - got);
+		rsblk_enc(32, 255, depth, blk);
+		fwrite(blk, 1, (size_t) 255 * depth, out);
+		blocks++;
+		if (got < dlen)
+			break;
+	}
+	free(blk);
+	STAT_STOP(ST_RS255, t0, (unsigned long long) blocks * dlen,
+		(unsigned long long) blocks * 255 * depth, (unsigned long long) blocks * depth);
+	return blocks;
+}
+
+// RS(255,223) stream decoder
+// A short last block has its missing bytes decoded as erasures.
+// returns number of codewords that could not be corrected
+int d_rs255(int depth, FILE *in, FILE *out)
+{
+	if (depth < 1)
+		return -1;
+
+	size_t blen = (size_t) 255 * depth;
+	unsigned char *blk = malloc(2 * blen);
+	if (blk == NULL)
+		return -1;
+	unsigned char *eras = blk + blen;
+	size_t got;
+	int fails = 0;
+	unsigned long long blocks = 0;
+
+	STAT_START(t0);
+	while ((got = fread(blk, 1, blen, in)) > 0)
+	{
+		if (got < blen)
+		{
+			memset(blk + got, 0, blen - got);
+			memset(eras, 0, got);
+			memset(eras + got, 1, blen - got);
+			fails += rsblk_dec(32, 255, depth, blk, eras, NULL);
+		}
+		else
+			fails += rsblk_dec(32, 255, depth, blk, NULL, NULL);
+		fwrite(blk, 1, (size_t) 223 * depth, out);
+		blocks++;
+		if (got < blen)
+			break;
+	}
+	free(blk);
+	STAT_STOP(ST_D_RS255, t0, blocks * blen, blocks * 223 * depth, blocks * depth);
+	return fails;
+}
+
+
+
+
+/* PRODUCT CODE */
+
+/* Two-dimensional code over a block of k+m packets:
+ *  - inner code along each packet (row): Hamming (7,4) laid out as in h74,
+ *    or interleaved shortened RS with nr parity symbols
+ *  - outer code down each byte position (column): RS with m parity
+ *    symbols, across packets like rskm, but able to fix errors too
+ *
+ * Encoding does the columns first and then the rows, so the parity
+ * packets are protected by the inner code like any other packet.
+ *
+ * Decoding goes back and forth: rows the inner code cannot vouch for
+ * become erasures for the columns; columns the outer code fixes are
+ * written back into the rows, so the next row pass has fewer errors to
+ * deal with. This stops when nothing is left erased, nothing changes,
+ * or after iters rounds. Rows within a pass, and columns within a pass,
+ * are independent, so each pass is split across nthreads threads.
+ */
+
+struct prodpool;
+
+struct prodblk {
+	int k, m, inner, nr;
+	unsigned int plen;
+	unsigned int rd;	// data bytes per row
+	int rn, rdepth;		// inner RS codeword length and interleave depth
+	unsigned char *w;	// the received rows, as being corrected
+	unsigned char *d;	// the data part of every row (column codewords)
+	unsigned char *e;	// erasure flag per byte of d
+	unsigned char *e2;	// same, but only for dropped rows
+	unsigned char *dropped;	// rows that were not received at all
+	int *res;		// column results
+	int nthreads;
+	struct prodpool *pool;	// worker threads, d_prod only
+};
+
+// Work out the row layout. returns -1 if the parameters don't fit
+static int prod_setup(struct prodblk *b, int k, int m, int inner, int nr,
+	unsigned int plen)
+{
+	b->k = k;
+	b->m = m;
+	b->inner = inner;
+	b->nr = nr;
+	b->plen = plen;
+	if (k < 1 || m < 1 || k + m > 255 || plen > 65535)
+		return -1;
+	if (inner == PROD_HAM)
+	{
+		if (plen < 7)
+			return -1;
+		b->rd = 4 * (plen / 7);
+		return 0;
+	}
+	if (inner == PROD_RS)
+	{
+		// as few interleaved codewords as fit the packet
+		b->rdepth = (plen + 254) / 255;
+		b->rn = plen / b->rdepth;
+		if (nr < 1 || b->rn <= nr)
+			return -1;
+		b->rd = (unsigned int) (b->rn - nr) * b->rdepth;
+		return 0;
+	}
+	return -1;
+}
+
+// Inner encode row r from its data in d
+static void prod_rowenc(struct prodblk *b, int r)
+{
+	unsigned char *row = b->w + (size_t) r * b->plen;
+	const unsigned char *dat = b->d + (size_t) r * b->rd;
+
+	memset(row, 0, b->plen);
+	if (b->inner == PROD_HAM)
+	{
+		for (unsigned int g = 0; g < b->plen / 7; g++)
+		{
+			unsigned char *c = row + 7 * g;
+			memcpy(c, dat + 4 * g, 4);
+			c[4] = c[0] ^ c[1] ^ c[3];
+			c[5] = c[0] ^ c[2] ^ c[3];
+			c[6] = c[1] ^ c[2] ^ c[3];
+		}
+	}
+	else
+	{
+		memcpy(row, dat, b->rd);
+		rsblk_enc(b->nr, b->rn, b->rdepth, row);
+	}
+}
+
+// Inner decode row r, then refresh its data and erasure flags.
+// Hamming cannot tell when it got a codeword wrong, so a row is only
+// trusted if at most one code in eight needed a bit flipped.
+static void prod_rowdec(struct prodblk *b, int r)
+{
+	unsigned char *row = b->w + (size_t) r * b->plen;
+	unsigned char *dat = b->d + (size_t) r * b->rd;
+	unsigned char *e = b->e + (size_t) r * b->rd;
+
+	if (b->dropped[r])
+	{
+		memset(e, 1, b->rd);
+		return;
+	}
+
+	if (b->inner == PROD_HAM)
+	{
+		unsigned int groups = b->plen / 7;
+		unsigned int flipped = 0;
+		for (unsigned int g = 0; g < groups; g++)
+			flipped += __builtin_popcount(h74_fix(row + 7 * g));
+		for (unsigned int g = 0; g < groups; g++)
+			memcpy(dat + 4 * g, row + 7 * g, 4);
+		memset(e, flipped > groups, b->rd);
+		return;
+	}
+
+	// RS rows: only the data bytes of failed codewords are erased
+	int res[b->rdepth];	// up to 257, for plen 65281 and up
+	rsblk_dec(b->nr, b->rn, b->rdepth, row, NULL, res);
+	memcpy(dat, row, b->rd);
+	for (unsigned int i = 0; i < b->rd; i++)
+		e[i] = res[i % b->rdepth] < 0;
+}
+
+// Put the (possibly corrected) data of row r back into the row, with
+// parity to match where the columns vouch for the data, so the next row
+// pass doesn't see a data/parity mismatch and "fix" data that is right:
+//  - a dropped row the columns rebuilt all the way is encoded again
+//  - a Hamming group whose 4 data bytes are all vouched for gets its
+//    parity again (Hamming parity depends on nothing else)
+//  - RS rows keep the parity they came with; the RS decoder fixes wrong
+//    parity bytes itself, and with the parity it came with it can still
+//    catch a column that was miscorrected
+static void prod_rowput(struct prodblk *b, int r)
+{
+	unsigned char *row = b->w + (size_t) r * b->plen;
+	const unsigned char *dat = b->d + (size_t) r * b->rd;
+	const unsigned char *e = b->e + (size_t) r * b->rd;
+
+	if (b->dropped[r] && memchr(e, 1, b->rd) == NULL)
+		prod_rowenc(b, r);
+	else if (b->inner == PROD_HAM)
+		for (unsigned int g = 0; g < b->plen / 7; g++)
+		{
+			unsigned char *c = row + 7 * g;
+			memcpy(c, dat + 4 * g, 4);
+			if ((e[4 * g] | e[4 * g + 1] | e[4 * g + 2] | e[4 * g + 3]) == 0)
+			{
+				c[4] = c[0] ^ c[1] ^ c[3];
+				c[5] = c[0] ^ c[2] ^ c[3];
+				c[6] = c[1] ^ c[2] ^ c[3];
+			}
+		}
+	else
+		memcpy(row, dat, b->rd);
+}
+
+// Thread tid's share of one pass: 0 rows, 1 columns, 2 put rows back
+static void prod_work(struct prodblk *b, int tid, int pass)
+{
+	int n = b->k + b->m;
+
+	if (pass == 0)
+	{
+		for (int r = tid; r < n; r += b->nthreads)
+			prod_rowdec(b, r);
+	}
+	else if (pass == 1)
+	{
+		// columns in chunks of whole gfv lanes
+		unsigned int per = (b->rd + b->nthreads - 1) / b->nthreads;
+		per = (per + GFV_LANES - 1) / GFV_LANES * GFV_LANES;
+		unsigned int c0 = tid * per;
+		unsigned int c1 = c0 + per < b->rd ? c0 + per : b->rd;
+		if (c0 < c1)
+			rs_decrange(b->m, n, b->rd, c0, c1, b->d, b->e, b->res);
+		for (unsigned int c = c0; c < c1; c++)
+		{
+			// Too many erasures: the rows the inner code gave up on
+			// are mostly right, so try again fixing them as errors.
+			if (b->res[c] < 0)
+				rs_decrange(b->m, n, b->rd, c, c + 1, b->d, b->e2, b->res);
+			if (b->res[c] >= 0)
+				for (int r = 0; r < n; r++)
+					b->e[(size_t) r * b->rd + c] = 0;
+		}
+	}
+	else
+	{
+		for (int r = tid; r < n; r += b->nthreads)
+			prod_rowput(b, r);
+	}
+}
+
+/* The worker threads are started once per d_prod call and wait between
+ * passes; each pass bumps gen and the caller waits for busy to reach 0.
+ * A thread that could not be started has its share done by the caller.
+ */
+
+struct prodjob {
+	struct prodblk *b;
+	int tid;
+	int started;
+	pthread_t th;
+	struct fecstats st;
+};
+
+struct prodpool {
+	pthread_mutex_t lock;
+	pthread_cond_t go, done;
+	unsigned long gen;	// passes started
+	int pass;
+	int busy;		// threads still on this pass
+	int nstarted;
+	int quit;
+	struct prodjob *job;
+};
+
+static void *prod_thread(void *arg)
+{
+	struct prodjob *j = arg;
+	struct prodpool *pl = j->b->pool;
+	unsigned long seen = 0;
+
+	memset(&j->st, 0, sizeof(j->st));
+	fecstats_use(&j->st);
+	pthread_mutex_lock(&pl->lock);
+	for (;;)
+	{
+		while (pl->gen == seen && !pl->quit)
+			pthread_cond_wait(&pl->go, &pl->lock);
+		if (pl->quit)
+			break;
+		seen = pl->gen;
+		int pass = pl->pass;
+		pthread_mutex_unlock(&pl->lock);
+		prod_work(j->b, j->tid, pass);
+		pthread_mutex_lock(&pl->lock);
+		if (--pl->busy == 0)
+			pthread_cond_signal(&pl->done);
+	}
+	pthread_mutex_unlock(&pl->lock);
+	fecstats_use(NULL);
+	return NULL;
+}
+
+// Start the worker threads (none for one thread)
+// returns -1 if out of memory
+static int prod_start(struct prodblk *b)
+{
+	b->pool = NULL;
+	if (b->nthreads == 1)
+		return 0;
+
+	struct prodpool *pl = calloc(1, sizeof(*pl));
+	if (pl == NULL || (pl->job = calloc(b->nthreads, sizeof(struct prodjob))) == NULL)
+	{
+		free(pl);
+		return -1;
+	}
+	pthread_mutex_init(&pl->lock, NULL);
+	pthread_cond_init(&pl->go, NULL);
+	pthread_cond_init(&pl->done, NULL);
+	b->pool = pl;
+	for (int t = 0; t < b->nthreads; t++)
+	{
+		struct prodjob *j = &pl->job[t];
+		j->b = b;
+		j->tid = t;
+		j->started = pthread_create(&j->th, NULL, prod_thread, j) == 0;
+		pl->nstarted += j->started;
+	}
+	return 0;
+}
+
+static void prod_stop(struct prodblk *b)
+{
+	struct prodpool *pl = b->pool;
+	if (pl == NULL)
+		return;
+	pthread_mutex_lock(&pl->lock);
+	pl->quit = 1;
+	pthread_cond_broadcast(&pl->go);
+	pthread_mutex_unlock(&pl->lock);
+	for (int t = 0; t < b->nthreads; t++)
+		if (pl->job[t].started)
+		{
+			pthread_join(pl->job[t].th, NULL);
+			stat_merge(&pl->job[t].st);
+		}
+	pthread_mutex_destroy(&pl->lock);
+	pthread_cond_destroy(&pl->go);
+	pthread_cond_destroy(&pl->done);
+	free(pl->job);
+	free(pl);
+	b->pool = NULL;
+}
+
+// Run one pass on the worker threads (or on this one)
+static void prod_pass(struct prodblk *b, int pass)
+{
+	struct prodpool *pl = b->pool;
+
+	if (pl == NULL)
+	{
+		prod_work(b, 0, pass);
+		return;
+	}
+	pthread_mutex_lock(&pl->lock);
+	pl->pass = pass;
+	pl->gen++;
+	pl->busy = pl->nstarted;
+	pthread_cond_broadcast(&pl->go);
+	pthread_mutex_unlock(&pl->lock);
+	for (int t = 0; t < b->nthreads; t++)
+		if (!pl->job[t].started)
+			prod_work(b, t, pass);
+	pthread_mutex_lock(&pl->lock);
+	while (pl->busy > 0)
+		pthread_cond_wait(&pl->done, &pl->lock);
+	pthread_mutex_unlock(&pl->lock);
+}
+
+// Product code encoder
+// k data packets and m parity packets per block, each plen bytes.
+// inner = PROD_HAM or PROD_RS (with nr parity symbols per row codeword)
+// returns number of packets written
+int prod(int k, int m, int inner, int nr, unsigned int plen, FILE *in, FILE *out)
+{
+	struct prodblk b;
+	plen = plenof(plen);
+	if (prod_setup(&b, k, m, inner, nr, plen) < 0)
+		return -1;
+	gf_init();
+
+	int n = k + m;
+	b.w = malloc((size_t) n * (plen + b.rd));
+	if (b.w == NULL)
+		return -1;
+	b.d = b.w + (size_t) n * plen;
+
+	size_t dlen = (size_t) k * b.rd;
+	size_t got;
+	int pcount = 0;
+
+	STAT_START(t0);
+	while ((got = fread(b.d, 1, dlen, in)) > 0)
+	{
+		memset(b.d + got, 0, dlen - got);
+		// columns, then rows
+		rsblk_enc(m, n, b.rd, b.d);
+		for (int r = 0; r < n; r++)
+			prod_rowenc(&b, r);
+		fwrite(b.w, 1, (size_t) n * plen, out);
+		pcount += n;
+		if (got < dlen)
+			break;
+	}
+	free(b.w);
+	STAT_STOP(ST_PROD, t0, (unsigned long long) pcount / n * dlen,
+		(unsigned long long) pcount * plen, pcount);
+	return pcount;
+}
+
+// Product code decoder
+// pnum = number of packets (as returned by prod), eras = NULL or one flag
+// per packet (nonzero = erased); if NULL, all-0 packets count as dropped.
+// iters = maximum number of row/column rounds, nthreads = threads to use.
+// returns number of data bytes that are still erased
+int d_prod(int k, int m, int inner, int nr, unsigned int plen, int pnum,
+	const unsigned char *eras, int iters, int nthreads, FILE *in, FILE *out)
+{
+	struct prodblk b;
+	plen = plenof(plen);
+	if (prod_setup(&b, k, m, inner, nr, plen) < 0)
+		return -1;
+	if (nthreads < 1)
+		nthreads = 1;
+	if (iters < 1)
+		iters = 1;
+	gf_init(); // before any threads start
+	b.nthreads = nthreads;
+
+	int n = k + m;
+	size_t wlen = (size_t) n * plen;
+	size_t dlen = (size_t) n * b.rd;
+	b.w = malloc(wlen + 3 * dlen + n);
+	if (b.w == NULL)
+		return -1;
+	b.d = b.w + wlen;
+	b.e = b.d + dlen;
+	b.e2 = b.e + dlen;
+	b.dropped = b.e2 + dlen;
+	b.res = malloc(b.rd * sizeof(int));
+	if (b.res == NULL || prod_start(&b) < 0)
+	{
+		free(b.res);
+		free(b.w);
+		return -1;
+	}
+
+	int left = 0;
+	STAT_START(t0);
+	for (int p = 0; p < pnum; p += n)
+	{
+		size_t got = fread(b.w, 1, wlen, in);
+		memset(b.w + got, 0, wlen - got);
+		for (int r = 0; r < n; r++)
+		{
+			if (p + r >= pnum)
+				b.dropped[r] = 1;
+			else if (eras != NULL)
+				b.dropped[r] = eras[p + r] != 0;
+			else
+			{
+				const unsigned char *row = b.w + (size_t) r * plen;
+				unsigned char superzip = 0x00;
+				for (unsigned int i = 0; i < plen; i++)
+					superzip |= row[i];
+				b.dropped[r] = superzip == 0x00;
+			}
+		}
+
+		size_t erased = dlen + 1;
+		for (int it = 0; it < iters; it++)
+		{
+			for (int r = 0; r < n; r++)
+				memset(b.e2 + (size_t) r * b.rd, b.dropped[r], b.rd);
+			prod_pass(&b, 0);
+			prod_pass(&b, 1);
+			// dropped rows are rebuilt now if their columns were fixed
+			size_t now = 0;
+			for (size_t i = 0; i < dlen; i++)
+				now += b.e[i];
+			if (now == 0 || now >= erased)
+				break;
+			erased = now;
+			prod_pass(&b, 2);
+			// a rebuilt row (encoded again by prod_rowput) can go
+			// through the inner code next time
+			for (int r = 0; r < n; r++)
+				if (b.dropped[r])
+				{
+					size_t bad = 0;
+					for (unsigned int i = 0; i < b.rd; i++)
+						bad += b.e[(size_t) r * b.rd + i];
+					if (bad == 0)
+						b.dropped[r] = 0;
+				}
+		}
+		for (size_t i = 0; i < (size_t) k * b.rd; i++)
+			left += b.e[i];
+		fwrite(b.d, 1, (size_t) k * b.rd, out);
+	}
+	prod_stop(&b);
+	free(b.res);
+	free(b.w);
+	STAT_STOP(ST_D_PROD, t0, (unsigned long long) pnum * plen,
+		(unsigned long long) ((pnum + n - 1) / n) * k * b.rd, pnum);
+	return left;
+}
+
+
+
+
+/* EMERGENCY MODE */
+
+// Repetition: every packet is sent r times in a row.
+// Wasteful, but the only thing that still works when most packets are lost.
+
+// returns number of packets written
+int rep(int r, unsigned int plen, FILE *in, FILE *out)
+{
+	plen = plenof(plen);
+	if (r < 1 || plen == 0 || plen > 65535)
+		return -1;
+
+	unsigned char packet[plen];
+	int pcount = 0;
+	size_t got;
+
+	STAT_START(t0);
+	while ((got = fread(packet, 1, plen, in)) > 0)
+	{
+		for (size_t i = got; i < plen; i++)
+			packet[i] = 0x00;
+		for (int i = 0; i < r; i++)
+			fwrite(packet, 1, plen, out);
+		pcount += r;
+		if (got < plen)
+			break;
+	}
+	STAT_STOP(ST_REP, t0, (unsigned long long) pcount / r * plen,
+		(unsigned long long) pcount * plen, pcount);
+	return pcount;
+}
+
+// Decode repetition: for each group of r copies, write the first one
+// that is not all 0s (ie. was not dropped by decUDP).
+// returns number of packets with no surviving copy
+int d_rep(int r, unsigned int plen, int pnum, FILE *in, FILE *out)
+{
+	plen = plenof(plen);
+	if (r < 1 || plen == 0 || plen > 65535)
+		return -1;
+
+	unsigned char packet[plen];
+	unsigned char keep[plen];
+	int missing = 0;
+
+	STAT_START(t0);
+	for (int p = 0; p < pnum; p += r)
+	{
+		int found = 0;
+		for (unsigned int b = 0; b < plen; b++)
+			keep[b] = 0x00;
+		for (int i = 0; i < r && p + i < pnum; i++)
+		{
+			size_t got = fread(packet, 1, plen, in);
+			for (size_t b = got; b < plen; b++)
+				packet[b] = 0x00;
+			if (found)
+				continue;
+			unsigned char superzip = 0x00;
+			for (unsigned int b = 0; b < plen; b++)
+				superzip |= packet[b];
+			if (superzip != 0x00)
+			{
+				for (unsigned int b = 0; b < plen; b++)
+					keep[b] = packet[b];
+				found = 1;
+			}
+		}
+		if (!found)
+			missing++;
+		fwrite(keep, 1, plen, out);
+	}
+	STAT_STOP(ST_D_REP, t0, (unsigned long long) pnum * plen,
+		(unsigned long long) ((pnum + r - 1) / r) * plen, pnum);
+	return missing;
+}
+
+
+
+
+// Convolutional code
+
+/* Rate 1/2, K=7 convolutional code with the CCSDS polynomials
+ * (0171, 0133, second output inverted), optionally punctured to 2/3 or
+ * 3/4, for the emergency link where bit errors are too dense for
+ * Hamming (7,4).
+ *
+ * Data goes in frames of CONV_FRAME bytes, bits MSB first, each frame
+ * followed by 6 zero bits so the encoder ends back in state 0. The last
+ * frame is padded with 0s. On the link, symbols are packed MSB first and
+ * each frame is padded to a whole byte.
+ *
+ * The decoder is a Viterbi decoder over 64 states with 16 bit path
+ * metrics. Soft input is one byte per symbol (0 = surely 0, 255 = surely
+ * 1); hard input is unpacked to 0/255 first. The add-compare-select for
+ * all 64 states is done 8 states per SSE2 instruction; the butterfly
+ * pairs old states s and s+32 into new states 2s and 2s+1, whose branch
+ * symbols are complements of each other, so only one branch metric is
+ * needed per pair.
+ */
+
+#define CONV_STEPS (8 * CONV_FRAME + 6)
+
+// sr = (sr << 1) | bit, so the taps are 0171 and 0133 bit-reversed
+#define CONV_POLYA 0x4f
+#define CONV_POLYB 0x6d
+
+// which of (c1, c2) are sent, for each step of the puncturing pattern
+static const unsigned char conv_keep[3][3][2] = {
+	{ {1,1} },			// 1/2
+	{ {1,1}, {0,1} },		// 2/3
+	{ {1,1}, {0,1}, {1,0} },	// 3/4
+};
+static const int conv_period[3] = { 1, 2, 3 };
+
+// Symbols on the link for one frame
+int conv_nsym(int rate)
+{
+	if (rate < CONV_12 || rate > CONV_34)
+		return -1;
+	int n = 0;
+	for (int t = 0; t < CONV_STEPS; t++)
+	{
+		const unsigned char *k = conv_keep[rate][t % conv_period[rate]];
+		n += k[0] + k[1];
+	}
+	return n;
+}
+
+// Output pair (c1 << 1 | c2) for a 7 bit shift register
+static inline int conv_out(int sr)
+{
+	return __builtin_parity(sr & CONV_POLYA) << 1
+		| (__builtin_parity(sr & CONV_POLYB) ^ 1);
+}
+
+// Encode one frame (CONV_FRAME bytes) into packed symbols.
+// returns number of bytes written to out
+int convblk_enc(int rate, const unsigned char *in, unsigned char *out)
+{
+	int sr = 0;
+	int nsym = 0;
+
+	memset(out, 0, (conv_nsym(rate) + 7) / 8);
+	for (int t = 0; t < CONV_STEPS; t++)
+	{
+		int bit = t < 8 * CONV_FRAME ? (in[t / 8] >> (7 - t % 8)) & 1 : 0;
+		sr = ((sr << 1) | bit) & 0x7f;
+		int o = conv_out(sr);
+		const unsigned char *k = conv_keep[rate][t % conv_period[rate]];
+		if (k[0])
+		{
+			out[nsym / 8] |= ((o >> 1) & 1) << (7 - nsym % 8);
+			nsym++;
+		}
+		if (k[1])
+		{
+			out[nsym / 8] |= (o & 1) << (7 - nsym % 8);
+			nsym++;
+		}
+	}
+	return (nsym + 7) / 8;
+}
+
+// Viterbi decode one frame of soft symbols into CONV_FRAME bytes
+void convblk_dec(int rate, const unsigned char *sym, unsigned char *out)
+{
+	// decision bit per new state per step: 1 = came from old state + 32
+	static _Thread_local uint64_t dec[CONV_STEPS];
+	// branch symbols from old state s (s < 32) on a 0 input
+	unsigned char x[32];
+
+	for (int s = 0; s < 32; s++)
+		x[s] = (unsigned char) conv_out(s << 1);
+
+	const unsigned char *k;
+	int ns = 0;
+
+#ifdef __SSE2__
+	// which lanes expect each of the 4 symbol pairs
+	__m128i sel[4][4];
+	for (int p = 0; p < 4; p++)
+		for (int v = 0; v < 4; v++)
+		{
+			short m[8];
+			for (int l = 0; l < 8; l++)
+				m[l] = x[8*v + l] == p ? -1 : 0;
+			sel[p][v] = _mm_loadu_si128((const __m128i *) m);
+		}
+
+	__m128i pm[8];
+	pm[0] = _mm_set_epi16(1000, 1000, 1000, 1000, 1000, 1000, 1000, 0);
+	for (int v = 1; v < 8; v++)
+		pm[v] = _mm_set1_epi16(1000);
+
+	for (int t = 0; t < CONV_STEPS; t++)
+	{
+		// cost of each possible symbol pair; punctured symbols cost 0
+		int c1 = 0, c2 = 0;
+		k = conv_keep[rate][t % conv_period[rate]];
+		if (k[0])
+			c1 = sym[ns++] >> 4;
+		if (k[1])
+			c2 = sym[ns++] >> 4;
+		short cost[4];
+		for (int p = 0; p < 4; p++)
+			cost[p] = (short) ((k[0] ? ((p & 2) ? 15 - c1 : c1) : 0)
+				+ (k[1] ? ((p & 1) ? 15 - c2 : c2) : 0));
+
+		__m128i npm[8];
+		uint64_t d = 0;
+		for (int v = 0; v < 4; v++)
+		{
+			__m128i bm = _mm_setzero_si128(), bmc = _mm_setzero_si128();
+			for (int p = 0; p < 4; p++)
+			{
+				bm = _mm_or_si128(bm, _mm_and_si128(sel[p][v], _mm_set1_epi16(cost[p])));
+				bmc = _mm_or_si128(bmc, _mm_and_si128(sel[3-p][v], _mm_set1_epi16(cost[p])));
+			}
+			__m128i a = pm[v], b = pm[v + 4];
+			__m128i m0a = _mm_add_epi16(a, bm), m0b = _mm_add_epi16(b, bmc);
+			__m128i m1a = _mm_add_epi16(a, bmc), m1b = _mm_add_epi16(b, bm);
+			__m128i n0 = _mm_min_epi16(m0a, m0b), n1 = _mm_min_epi16(m1a, m1b);
+			__m128i d0 = _mm_cmpgt_epi16(m0a, m0b), d1 = _mm_cmpgt_epi16(m1a, m1b);
+			// new states 2s and 2s+1 side by side
+			npm[2*v] = _mm_unpacklo_epi16(n0, n1);
+			npm[2*v + 1] = _mm_unpackhi_epi16(n0, n1);
+			__m128i dd = _mm_packs_epi16(_mm_unpacklo_epi16(d0, d1), _mm_unpackhi_epi16(d0, d1));
+			d |= (uint64_t) (unsigned) _mm_movemask_epi8(dd) << (16 * v);
+		}
+		for (int v = 0; v < 8; v++)
+			pm[v] = npm[v];
+		dec[t] = d;
+
+		// keep the metrics small
+		if ((t & 63) == 63)
+		{
+			short m[64];
+			for (int v = 0; v < 8; v++)
+				_mm_storeu_si128((__m128i *) (m + 8*v), pm[v]);
+			short lo = m[0];
+			for (int s = 1; s < 64; s++)
+				if (m[s] < lo)
+					lo = m[s];
+			for (int v = 0; v < 8; v++)
+				pm[v] = _mm_sub_epi16(pm[v], _mm_set1_epi16(lo));
+		}
+	}
+#else
+	unsigned short pm[64], npm[64];
+	for (int s = 0; s < 64; s++)
+		pm[s] = s ? 1000 : 0;
+
+	for (int t = 0; t < CONV_STEPS; t++)
+	{
+		int c1 = 0, c2 = 0;
+		k = conv_keep[rate][t % conv_period[rate]];
+		if (k[0])
+			c1 = sym[ns++] >> 4;
+		if (k[1])
+			c2 = sym[ns++] >> 4;
+		unsigned short cost[4];
+		for (int p = 0; p < 4; p++)
+			cost[p] = (unsigned short) ((k[0] ? ((p & 2) ? 15 - c1 : c1) : 0)
+				+ (k[1] ? ((p & 1) ? 15 - c2 : c2) : 0));
+
+		uint64_t d = 0;
+		for (int s = 0; s < 32; s++)
+		{
+			unsigned short bm = cost[x[s]], bmc = cost[3 - x[s]];
+			unsigned short m0a = pm[s] + bm, m0b = pm[s+32] + bmc;
+			unsigned short m1a = pm[s] + bmc, m1b = pm[s+32] + bm;
+			npm[2*s] = m0a > m0b ? m0b : m0a;
+			npm[2*s + 1] = m1a > m1b ? m1b : m1a;
+			d |= (uint64_t) (m0a > m0b) << (2*s);
+			d |= (uint64_t) (m1a > m1b) << (2*s + 1);
+		}
+		memcpy(pm, npm, sizeof(pm));
+		dec[t] = d;
+
+		if ((t & 63) == 63)
+		{
+			unsigned short lo = pm[0];
+			for (int s = 1; s < 64; s++)
+				if (pm[s] < lo)
+					lo = pm[s];
+			for (int s = 0; s < 64; s++)
+				pm[s] -= lo;
+		}
+	}
+#endif
+
+	// trace back from state 0 (the tail bits put the encoder there)
+	int s = 0;
+	memset(out, 0, CONV_FRAME);
+	for (int t = CONV_STEPS - 1; t >= 0; t--)
+	{
+		if (t < 8 * CONV_FRAME)
+			out[t / 8] |= (s & 1) << (7 - t % 8);
+		s = (s >> 1) | (int) ((dec[t] >> s) & 1) << 5;
+	}
+}
+
+// Convolutional encoder
+// rate = CONV_12, CONV_23 or CONV_34. returns number of frames
+int conv(int rate, FILE *in, FILE *out)
+{
+	if (rate < CONV_12 || rate > CONV_34)
+		return -1;
+
+	unsigned char buf[CONV_FRAME];
+	unsigned char sym[2 * CONV_FRAME + 2];
+	int frames = 0;
+	size_t got;
+
+	STAT_START(t0);
+	while ((got = fread(buf, 1, CONV_FRAME, in)) > 0)
+	{
+		memset(buf + got, 0, CONV_FRAME - got);
+		fwrite(sym, 1, convblk_enc(rate, buf, sym), out);
+		frames++;
+		if (got < CONV_FRAME)
+			break;
+	}
+	STAT_STOP(ST_CONV, t0, (unsigned long long) frames * CONV_FRAME,
+		(unsigned long long) frames * ((conv_nsym(rate) + 7) / 8), frames);
+	return frames;
+}
+
+// Viterbi decoder
+// soft = 0: packed hard symbols, as written by conv
+// soft = 1: one byte per symbol, 0 .. 255
+// returns number of frames
+int d_conv(int rate, int soft, FILE *in, FILE *out)
+{
+	if (rate < CONV_12 || rate > CONV_34)
+		return -1;
+
+	int nsym = conv_nsym(rate);
+	size_t flen = soft ? (size_t) nsym : (size_t) (nsym + 7) / 8;
+	unsigned char raw[2 * CONV_STEPS];
+	unsigned char sym[2 * CONV_STEPS];
+	unsigned char buf[CONV_FRAME];
+	int frames = 0;
+	size_t got;
+
+	STAT_START(t0);
+	while ((got = fread(raw, 1, flen, in)) > 0)
+	{
+		if (soft)
+		{
+			memcpy(sym, raw, got);
+			memset(sym + got, 128, flen - got); // missing: don't know
+		}
+		else
+		{
+			memset(raw + got, 0, flen - got);
+			for (int i = 0; i < nsym; i++)
+				sym[i] = (raw[i / 8] >> (7 - i % 8)) & 1 ? 255 : 0;
+		}
+		convblk_dec(rate, sym, buf);
+		fwrite(buf, 1, CONV_FRAME, out);
+		frames++;
+		if (got < flen)
+			break;
+	}
+	STAT_STOP(ST_D_CONV, t0, (unsigned long long) frames * flen,
+		(unsigned long long) frames * CONV_FRAME, frames);
+	return frames;
+}
+
+
+
+
+/* PASS PLANNING */
+
+/* How much n/k to send in a pass.
+ *
+ * Channel model: bits are flipped independently with probability ber, and
+ * on top of that a fraction loss of packets never arrives. A packet is also
+ * lost if any of the 48 checked header bits is wrong (see addUDP).
+ *
+ * For each codec the planner works out
+ *  - rate: data bytes per byte on air, UDP headers included
+ *  - goodput: the expected fraction of sent data bytes that come out right
+ * and then how much data fits in the pass. If the queue is bigger than the
+ * pass, the best rate*goodput wins; if the queue fits, the extra air time
+ * goes into redundancy until the queue no longer fits.
+ *
+ * Hamming: a lost packet zeroes one bit of every codeword in the group,
+ * which is wrong half the time. Each codeword survives one wrong bit,
+ * and a data byte needs all 8 of its codewords to survive.
+ * RS(k,m): a group survives up to m lost packets. Bit errors inside
+ * received packets are not corrected.
+ * Repetition: a packet survives if any of its r copies arrives.
+ */
+
+// x^n by squaring; avoids needing libm
+static double powi(double x, unsigned long n)
+{
+	double r = 1.0;
+	while (n)
+	{
+		if (n & 1)
+			r *= x;
+		x *= x;
+		n >>= 1;
+	}
+	return r;
+}
+
+// Probability of more than m losses out of n, each lost with probability p
+static double binomtail(int n, int m, double p)
+{
+	if (m >= n)
+		return 0.0;
+	if (p <= 0.0)
+		return 0.0;
+	if (p >= 1.0)
+		return 1.0;
+	double term = powi(1.0 - p, n); // P(0 lost)
+	double cum = 0.0;
+	for (int l = 0; l <= m; l++)
+	{
+		cum += term;
+		term *= (double) (n - l) / (l + 1) * p / (1.0 - p);
+	}
+	return cum >= 1.0 ? 0.0 : 1.0 - cum;
+}
+
+// Packet loss probability for a channel (header errors included)
+static double plossof(double ber, double loss)
+{
+	return 1.0 - (1.0 - loss) * powi(1.0 - ber, 48);
+}
+
+// Expected fraction of data packets recovered from an RS(k,m) group
+static double rsgood(int k, int m, double p)
+{
+	int n = k + m;
+	double good = 0.0;
+	double term = powi(1.0 - p, n);
+	for (int l = 0; l <= n; l++)
+	{
+		// decodable, or else only the data packets that arrived
+		good += term * (l <= m ? 1.0 : (double) (n - l) / n);
+		if (p >= 1.0)
+		{
+			good = 0.0;
+			break;
+		}
+		term *= (double) (n - l) / (l + 1) * p / (1.0 - p);
+	}
+	return good;
+}
+
+static void plantry(struct passplan *best, struct passplan *c,
+	double wire, unsigned long queue, unsigned int plen)
+{
+	c->plen = plen;
+	c->rate *= (double) plen / (plen + 8);
+	double sent = wire * c->rate;
+	if (sent > (double) queue)
+		sent = (double) queue;
+	c->delivered = sent * c->goodput;
+
+	// Ties go to the more robust option
+	if (best->codec == 0 || c->delivered > best->delivered * (1.0 + 1e-9)
+		|| (c->delivered >= best->delivered * (1.0 - 1e-9)
+		&& c->goodput > best->goodput * (1.0 + 1e-9)))
+		*best = *c;
+}
+
+// secs = pass length, bps = link bit rate, ber = bit error rate,
+// loss = packet loss on top of bit errors, queue = bytes waiting to be sent
+// returns 0, or -1 on bad input
+int planpass(double secs, double bps, double ber, double loss,
+	unsigned long queue, unsigned int plen, struct passplan *plan)
+{
+	plen = plenof(plen);
+	if (plan == NULL || plen < 8 || plen > 65535 || secs <= 0 || bps <= 0)
+		return -1;
+	if (ber < 0 || ber > 0.5 || loss < 0 || loss > 1)
+		return -1;
+
+	double wire = secs * bps / 8.0;
+	double p = plossof(ber, loss);
+	double byteok = powi(1.0 - ber, 8);
+	struct passplan best = { 0 };
+	struct passplan c;
+
+	// Hamming (7,4) interleaved across 7 packets
+	double q = p / 2.0 + (1.0 - p) * ber;
+	double cw = powi(1.0 - q, 7) + 7.0 * q * powi(1.0 - q, 6);
+	c = (struct passplan) { PLAN_HAM, 4, 3, 0, 4.0 / 7.0, powi(cw, 8), 0 };
+	plantry(&best, &c, wire, queue, plen);
+
+	// Reed-Solomon; m = 0 is plain UDP
+	for (int k = 1; k <= 64; k++)
+	{
+		for (int m = 0; m <= k; m++)
+		{
+			c = (struct passplan) { PLAN_RS, k, m, 0,
+				(double) k / (k + m), rsgood(k, m, p) * byteok, 0 };
+			plantry(&best, &c, wire, queue, plen);
+		}
+	}
+
+	// Emergency repetition
+	for (int r = 2; r <= 8; r++)
+	{
+		c = (struct passplan) { PLAN_REP, r, 0, 0,
+			1.0 / r, (1.0 - powi(p, r)) * byteok, 0 };
+		plantry(&best, &c, wire, queue, plen);
+	}
+
+	*plan = best;
+	return 0;
+}
+
+
+
+// Adaptive redundancy
+
+/* Between blocks, the ground reports how many packets decUDP dropped and
+ * the encoder picks the smallest m that keeps the chance of losing a
+ * group under target. The drop rate is smoothed so one clean block does
+ * not strip all the parity, but it goes up straight away when things get
+ * worse. The m used for each block has to reach the ground along with
+ * the drop report, since rskm packets do not carry it.
+ */
+
+void mctrl_init(struct mctrl *c, int k, int mmin, int mmax, double target)
+{
+	if (mmin < 0)
+		mmin = 0;
+	if (mmax > 255 - k)
+		mmax = 255 - k;
+	if (mmax < mmin)
+		mmax = mmin;
+	c->k = k;
+	c->m = mmin;
+	c->mmin = mmin;
+	c->mmax = mmax;
+	c->loss = 0.0;
+	c->target = target;
+}
+
+// dropped, total = decUDP's return value and pnum for the last block
+int mctrl_update(struct mctrl *c, int dropped, int total)
+{
+	if (total <= 0)
+		return c->m;
+
+	double seen = (double) dropped / total;
+	if (seen > c->loss)
+		c->loss = seen;
+	else
+		c->loss += (seen - c->loss) / 8.0;
+
+	int m = c->mmin;
+	while (m < c->mmax && binomtail(c->k + m, m, c->loss) > c->target)
+		m++;
+	c->m = m;
+	return m;
+}
+
+
+
+// Packet length tuning
+
+/* Longer packets spend less on headers but are more likely to take a
+ * bit error. This picks plen (and the rskm k, m to go with it) for
+ * inlvUDPcrc framing, where a packet with any bad bit is an erasure.
+ *
+ * Channel: Gilbert bursts. Bits are clean outside a burst and wrong half
+ * the time inside one; bursts average ch->burst bits and make up enough
+ * of the time to give an average of ch->ber. burst <= 1 is independent
+ * bit errors. ch->loss of packets go missing on top of that.
+ *
+ * With P = the bit to bit state change matrix and C the same but only
+ * along clean bits, a frame of L bits is clean with probability
+ * start * C^L * 1, and P^L - C^L covers the dirty frames. Every (k, m)
+ * is scored from that per-packet loss, as if packets failed
+ * independently; then the best few candidates are simulated packet by
+ * packet, carrying the burst state from one packet into the next, which
+ * is where long bursts hurt a group more than the model says.
+ */
+
+#define TUNE_SIM	6		// candidates to simulate
+#define TUNE_PACKETS	(1 << 17)	// packets simulated per candidate
+
+struct tunechan {
+	double pi[2];		// time spent good, bad
+	double clean[2][2];	// from state, clean frame, to state
+	double dirty[2][2];
+	double loss;
+};
+
+static void mat2mul(double r[2][2], double a[2][2], double b[2][2])
+{
+	double t[2][2];
+	for (int i = 0; i < 2; i++)
+		for (int j = 0; j < 2; j++)
+			t[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j];
+	memcpy(r, t, sizeof(t));
+}
+
+static void mat2pow(double r[2][2], double a[2][2], unsigned long n)
+{
+	double x[2][2];
+	memcpy(x, a, sizeof(x));
+	r[0][0] = r[1][1] = 1.0;
+	r[0][1] = r[1][0] = 0.0;
+	while (n)
+	{
+		if (n & 1)
+			mat2mul(r, r, x);
+		mat2mul(x, x, x);
+		n >>= 1;
+	}
+}
+
+// Frame statistics for frames of bits bits
+static void tune_chan(const struct fecchan *ch, unsigned long bits, struct tunechan *t)
+{
+	double eb, eg, a, b;
+
+	if (ch->burst <= 1.0 || ch->ber <= 0.0)
+	{	// independent errors: one state
+		eg = eb = ch->ber;
+		a = 0.0;
+		b = 1.0;
+	}
+	else
+	{
+		double bad = 2.0 * ch->ber;	// errors are 1/2 the bits in a burst
+		eg = 0.0;
+		eb = 0.5;
+		b = 1.0 / ch->burst;
+		a = bad >= 1.0 ? 1.0 : bad * b / (1.0 - bad);
+	}
+	double p[2][2] = { { 1.0 - a, a }, { b, 1.0 - b } };
+	double c[2][2] = { { (1.0 - eg) * (1.0 - a), (1.0 - eg) * a },
+		{ (1.0 - eb) * b, (1.0 - eb) * (1.0 - b) } };
+	double pl[2][2], cl[2][2];
+
+	mat2pow(pl, p, bits);
+	mat2pow(cl, c, bits);
+	t->pi[1] = a + b > 0.0 ? a / (a + b) : 0.0;
+	t->pi[0] = 1.0 - t->pi[1];
+	for (int i = 0; i < 2; i++)
+		for (int j = 0; j < 2; j++)
+		{
+			t->clean[i][j] = cl[i][j];
+			t->dirty[i][j] = pl[i][j] > cl[i][j] ? pl[i][j] - cl[i][j] : 0.0;
+		}
+	t->loss = ch->loss;
+}
+
+// Chance a packet is an erasure, in the long run
+static double tune_ploss(const struct tunechan *t)
+{
+	double ok = 0.0;
+	for (int i = 0; i < 2; i++)
+		ok += t->pi[i] * (t->clean[i][0] + t->clean[i][1]);
+	return 1.0 - (1.0 - t->loss) * ok;
+}
+
+// xorshift64*, uniform in [0, 1)
+static double tune_rand(uint64_t *s)
+{
+	*s ^= *s >> 12;
+	*s ^= *s << 25;
+	*s ^= *s >> 27;
+	return (double) ((*s * 0x2545f4914f6cdd1dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Simulate c: data bytes out per byte on air, and the data lost
+static void tune_sim(const struct tunechan *t, struct plentune *c)
+{
+	unsigned int plen = c->plen;
+	int k = c->k, m = c->m;
+	int n = k + m;
+	long groups = TUNE_PACKETS / n + 1;
+	uint64_t seed = 0x9e3779b97f4a7c15ull ^ ((uint64_t) plen << 32 | (uint64_t) k << 16 | m);
+	int s = tune_rand(&seed) < t->pi[1];
+	double delivered = 0.0;
+
+	for (long g = 0; g < groups; g++)
+	{
+		int lost = 0, datalost = 0;
+		for (int i = 0; i < n; i++)
+		{
+			double u = tune_rand(&seed);
+			int bad;
+			if (u < t->clean[s][0])
+				bad = 0, s = 0;
+			else if ((u -= t->clean[s][0]) < t->clean[s][1])
+				bad = 0, s = 1;
+			else if ((u -= t->clean[s][1]) < t->dirty[s][0])
+				bad = 1, s = 0;
+			else
+				bad = 1, s = 1;
+			if (!bad && t->loss > 0.0 && tune_rand(&seed) < t->loss)
+				bad = 1;
+			lost += bad;
+			if (i < k)
+				datalost += bad;
+		}
+		delivered += lost <= m ? k : k - datalost;
+	}
+	c->sim = delivered * (plen - 4) / ((double) groups * n * (plen + 8));
+	c->simresid = 1.0 - delivered / ((double) groups * k);
+}
+
+// a better than b: meeting the target first, then efficiency
+static int tune_better(double eff, double resid, double beff, double bresid,
+	double target)
+{
+	int ok = resid <= target, bok = bresid <= target;
+	if (ok != bok)
+		return ok;
+	if (!ok)
+		return resid < bresid * (1.0 - 1e-9);
+	return eff > beff * (1.0 + 1e-9);
+}
+
+// Sweep plen from pmin to pmax and rskm k (up to kmax) and m for the
+// most data out per byte on air over channel ch, with at most target of
+// the data lost after decoding (if nothing gets there, the least lost);
+// see above. best->eff and resid are the model's figures, sim and
+// simresid the simulation's; the pick is by the simulation.
+// Call setplen(best->plen) to have plen = 0 use it.
+// returns 0, or -1 on bad input
+int tuneplen(const struct fecchan *ch, double target, unsigned int pmin,
+	unsigned int pmax, int kmax, struct plentune *best)
+{
+	if (ch == NULL || best == NULL || ch->ber < 0 || ch->ber >= 0.5
+		|| ch->loss < 0 || ch->loss >= 1 || target < 0)
+		return -1;
+	if (pmin < 16)
+		pmin = 16;
+	if (pmax > 65535 - 8)
+		pmax = 65535 - 8;
+	if (pmax < pmin || kmax < 1)
+		return -1;
+	if (kmax > 128)
+		kmax = 128;
+
+	struct plentune cand[TUNE_SIM];
+	int ncand = 0;
+	struct tunechan t;
+
+	// model: best (k, m) for each plen, keeping the best few plens
+	for (unsigned int plen = pmin; plen <= pmax; )
+	{
+		tune_chan(ch, 8ul * (plen + 8), &t);
+		double p = tune_ploss(&t);
+		double frame = (double) (plen - 4) / (plen + 8);
+		struct plentune c = { plen, 1, 0, 0.0, 2.0, 0.0, 0.0 };
+
+		for (int k = 1; k <= kmax; k++)
+			for (int m = 0; m <= k && k + m <= 255; m++)
+			{
+				double good = rsgood(k, m, p);
+				double eff = (double) k / (k + m) * frame * good;
+				if (tune_better(eff, 1.0 - good, c.eff, c.resid, target))
+				{
+					c.k = k;
+					c.m = m;
+					c.eff = eff;
+					c.resid = 1.0 - good;
+				}
+			}
+
+		// insert, best first
+		int at = ncand < TUNE_SIM ? ncand++ : TUNE_SIM;
+		while (at > 0 && tune_better(c.eff, c.resid,
+			cand[at - 1].eff, cand[at - 1].resid, target))
+		{
+			if (at < TUNE_SIM)
+				cand[at] = cand[at - 1];
+			at--;
+		}
+		if (at < TUNE_SIM)
+			cand[at] = c;
+
+		// ~3% steps
+		unsigned int step = plen / 32 < 1 ? 1 : plen / 32;
+		if (plen < pmax && plen + step > pmax)
+			plen = pmax;
+		else
+			plen += step;
+	}
+
+	// simulation decides
+	for (int i = 0; i < ncand; i++)
+	{
+		tune_chan(ch, 8ul * (cand[i].plen + 8), &t);
+		tune_sim(&t, &cand[i]);
+		if (i == 0 || tune_better(cand[i].sim, cand[i].simresid,
+			best->sim, best->simresid, target))
+			*best = cand[i];
+	}
+	return 0;
+}
+
+
+
+
+/* PIPELINE */
+
+/* Runs a chain of block codecs on a stream with reading, coding and
+ * writing overlapped:
+ *
+ *   reader --> ring[i] --> codec thread i --> ring[W+i] --> writer
+ *
+ * The reader cuts the input into slots of stage[0].inlen bytes and deals
+ * them out to the W codec threads in turn; each codec thread runs every
+ * stage on its slot; the writer collects the results in the same turn
+ * order, so the output comes out in input order. Every ring has one
+ * producer and one consumer, so head and tail are plain atomic counters
+ * with no locks. A full ring makes its producer wait (backpressure), and
+ * each ring counts how often its producer and consumer had to wait, so
+ * it shows which side is the bottleneck. A wait spins for a little while
+ * and then sleeps on the ring's condition variable; the other side only
+ * takes the lock to wake it when someone is asleep.
+ */
+
+#define RING_SPIN	64	// yields before a wait goes to sleep
+
+struct fecring {
+	unsigned char *slots;
+	size_t *lens;
+	size_t slotsz;
+	unsigned int nslots;
+	_Atomic unsigned long head;	// slots written (producer)
+	_Atomic unsigned long tail;	// slots read (consumer)
+	_Atomic int done;		// producer has finished
+	_Atomic unsigned long fullwait;
+	_Atomic unsigned long emptywait;
+	_Atomic unsigned int hiwater;
+	_Atomic int sleepers;		// waiting on wake
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+struct fecpipe {
+	const struct fecstage *stages;
+	int nstages;
+	int nworkers;
+	unsigned int nslots;
+	struct fecring *rings;	// nworkers in, then nworkers out
+	size_t scratch;		// biggest stage output
+	FILE *in, *out;
+	unsigned long long written;
+	_Atomic int failed;
+	struct fecstats st[2];	// reader, writer
+};
+
+static int ring_init(struct fecring *r, unsigned int nslots, size_t slotsz)
+{
+	r->slots = malloc((size_t) nslots * slotsz);
+	r->lens = malloc(nslots * sizeof(size_t));
+	if (r->slots == NULL || r->lens == NULL)
+	{
+		free(r->slots);
+		free(r->lens);
+		return -1;
+	}
+	r->slotsz = slotsz;
+	r->nslots = nslots;
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	atomic_init(&r->done, 0);
+	atomic_init(&r->fullwait, 0);
+	atomic_init(&r->emptywait, 0);
+	atomic_init(&r->hiwater, 0);
+	atomic_init(&r->sleepers, 0);
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->wake, NULL);
+	return 0;
+}
+
+static void ring_free(struct fecring *r)
+{
+	free(r->slots);
+	free(r->lens);
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->wake);
+}
+
+// Can the producer (full = 1) or consumer (full = 0) go on?
+static int ring_ready(struct fecring *r, int full)
+{
+	unsigned long h = atomic_load(&r->head), t = atomic_load(&r->tail);
+	if (full)
+		return h - t < r->nslots;
+	return h != t || atomic_load(&r->done);
+}
+
+// Wait for ring_ready: spin a little, then sleep until the other side
+// moves. sleepers is set before the last check and read by ring_wake
+// after every move (both seq_cst), so a wakeup can't fall in between.
+static void ring_wait(struct fecring *r, int full)
+{
+	atomic_fetch_add_explicit(full ? &r->fullwait : &r->emptywait, 1, memory_order_relaxed);
+	for (int i = 0; i < RING_SPIN; i++)
+	{
+		sched_yield();
+		if (ring_ready(r, full))
+			return;
+	}
+	pthread_mutex_lock(&r->lock);
+	atomic_fetch_add(&r->sleepers, 1);
+	while (!ring_ready(r, full))
+		pthread_cond_wait(&r->wake, &r->lock);
+	atomic_fetch_sub(&r->sleepers, 1);
+	pthread_mutex_unlock(&r->lock);
+}
+
+static void ring_wake(struct fecring *r)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load(&r->sleepers) == 0)
+		return;
+	pthread_mutex_lock(&r->lock);
+	pthread_cond_broadcast(&r->wake);
+	pthread_mutex_unlock(&r->lock);
+}
+
+// Next free slot, waiting while the ring is full
+static unsigned char *ring_wslot(struct fecring *r)
+{
+	unsigned long h = atomic_load_explicit(&r->head, memory_order_relaxed);
+	if (h - atomic_load_explicit(&r->tail, memory_order_acquire) >= r->nslots)
+		ring_wait(r, 1);
+	return r->slots + (h % r->nslots) * r->slotsz;
+}
+
+static void ring_push(struct fecring *r, size_t len)
+{
+	unsigned long h = atomic_load_explicit(&r->head, memory_order_relaxed);
+	r->lens[h % r->nslots] = len;
+	atomic_store_explicit(&r->head, h + 1, memory_order_release);
+	ring_wake(r);
+
+	unsigned int fill = (unsigned int) (h + 1 - atomic_load_explicit(&r->tail, memory_order_relaxed));
+	if (fill > atomic_load_explicit(&r->hiwater, memory_order_relaxed))
+		atomic_store_explicit(&r->hiwater, fill, memory_order_relaxed);
+}
+
+static void ring_close(struct fecring *r)
+{
+	atomic_store_explicit(&r->done, 1, memory_order_release);
+	ring_wake(r);
+}
+
+// Oldest filled slot, waiting while the ring is empty.
+// NULL once the producer is done and everything has been read.
+static unsigned char *ring_rslot(struct fecring *r, size_t *len)
+{
+	unsigned long t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	if (atomic_load_explicit(&r->head, memory_order_acquire) == t)
+	{
+		ring_wait(r, 0);
+		if (atomic_load_explicit(&r->head, memory_order_acquire) == t)
+			return NULL;	// done, and everything read
+	}
+	*len = r->lens[t % r->nslots];
+	return r->slots + (t % r->nslots) * r->slotsz;
+}
+
+static void ring_pop(struct fecring *r)
+{
+	unsigned long t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	atomic_store_explicit(&r->tail, t + 1, memory_order_release);
+	ring_wake(r);
+}
+
+static void pipe_read(struct fecpipe *p)
+{
+	size_t inlen = p->stages[0].inlen;
+	int w = 0;
+
+	for (;;)
+	{
+		unsigned char *slot = ring_wslot(&p->rings[w]);
+		size_t got = fread(slot, 1, inlen, p->in);
+		if (got == 0)
+			break;
+		ring_push(&p->rings[w], got);
+		w = (w + 1) % p->nworkers;
+		if (got < inlen)
+			break;
+	}
+	for (int i = 0; i < p->nworkers; i++)
+		ring_close(&p->rings[i]);
+}
+
+static void *pipe_reader(void *arg)
+{
+	struct fecpipe *p = arg;
+
+	memset(&p->st[0], 0, sizeof(p->st[0]));
+	fecstats_use(&p->st[0]);
+	pipe_read(p);
+	fecstats_use(NULL);
+	return NULL;
+}
+
+struct pipejob {
+	struct fecpipe *p;
+	int id;
+	struct fecstats st;
+};
+
+static void *pipe_worker(void *arg)
+{
+	struct pipejob *j = arg;
+	struct fecpipe *p = j->p;
+	struct fecring *in = &p->rings[j->id];
+	struct fecring *out = &p->rings[p->nworkers + j->id];
+	unsigned char *buf = malloc(2 * p->scratch);
+	unsigned char *slot;
+	size_t len;
+
+	memset(&j->st, 0, sizeof(j->st));
+	fecstats_use(&j->st);
+	while ((slot = ring_rslot(in, &len)) != NULL)
+	{
+		unsigned char *dst = ring_wslot(out);
+		if (buf == NULL)
+		{
+			atomic_store(&p->failed, 1);
+			len = 0;
+		}
+		// ping-pong between the two scratch halves, last stage
+		// straight into the output slot
+		const unsigned char *src = slot;
+		for (int s = 0; s < p->nstages && buf != NULL; s++)
+		{
+			unsigned char *o = s == p->nstages - 1 ? dst : buf + (s & 1) * p->scratch;
+			len = p->stages[s].fn(p->stages[s].arg, src, len, o);
+			src = o;
+		}
+		ring_pop(in);
+		ring_push(out, len);
+	}
+	ring_close(out);
+	free(buf);
+	fecstats_use(NULL);
+	return NULL;
+}
+
+static void *pipe_writer(void *arg)
+{
+	struct fecpipe *p = arg;
+	int w = 0;
+	unsigned char *slot;
+	size_t len;
+
+	memset(&p->st[1], 0, sizeof(p->st[1]));
+	fecstats_use(&p->st[1]);
+	while ((slot = ring_rslot(&p->rings[p->nworkers + w], &len)) != NULL)
+	{
+		if (fwrite(slot, 1, len, p->out) != len)
+			atomic_store(&p->failed, 1);
+		p->written += len;
+		ring_pop(&p->rings[p->nworkers + w]);
+		w = (w + 1) % p->nworkers;
+	}
+	fecstats_use(NULL);
+	return NULL;
+}
+
+// The whole run on the calling thread, for when the threads can't be had
+static void pipe_inline(struct fecpipe *p)
+{
+	size_t inlen = p->stages[0].inlen;
+	unsigned char *buf = malloc(inlen + 2 * p->scratch);
+	size_t got;
+
+	if (buf == NULL)
+	{
+		atomic_store(&p->failed, 1);
+		return;
+	}
+	while ((got = fread(buf, 1, inlen, p->in)) > 0)
+	{
+		const unsigned char *src = buf;
+		size_t len = got;
+		for (int s = 0; s < p->nstages; s++)
+		{
+			unsigned char *o = buf + inlen + (s & 1) * p->scratch;
+			len = p->stages[s].fn(p->stages[s].arg, src, len, o);
+			src = o;
+		}
+		if (fwrite(src, 1, len, p->out) != len)
+			atomic_store(&p->failed, 1);
+		p->written += len;
+		if (got < inlen)
+			break;
+	}
+	free(buf);
+}
+
+// Set up a pipeline of nstages stages on nworkers codec threads, with
+// nslots slots (rounded up to a power of 2) in each ring. Each stage gets
+// the whole output of the one before, so its inlen must be at least the
+// outlen of the one before.
+// returns NULL on bad input or no memory
+struct fecpipe *fecpipe_new(const struct fecstage *stages, int nstages,
+	int nworkers, unsigned int nslots)
+{
+	if (stages == NULL || nstages < 1 || nworkers < 1 || nslots < 1)
+		return NULL;
+	for (int s = 1; s < nstages; s++)
+		if (stages[s].inlen < stages[s - 1].outlen)
+			return NULL;
+	gf_init();
+	hn_init();
+	rnd_init();
+	crc_init();
+
+	struct fecpipe *p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return NULL;
+	p->stages = stages;
+	p->nstages = nstages;
+	p->nworkers = nworkers;
+	p->nslots = 1;
+	while (p->nslots < nslots)
+		p->nslots <<= 1;
+	for (int s = 0; s < nstages; s++)
+		if (stages[s].outlen > p->scratch)
+			p->scratch = stages[s].outlen;
+
+	p->rings = calloc(2 * nworkers, sizeof(struct fecring));
+	if (p->rings == NULL)
+	{
+		free(p);
+		return NULL;
+	}
+	for (int i = 0; i < 2 * nworkers; i++)
+	{
+		size_t sz = i < nworkers ? stages[0].inlen : stages[nstages - 1].outlen;
+		if (ring_init(&p->rings[i], p->nslots, sz) < 0)
+		{
+			for (int j = 0; j < i; j++) // free what we have
+				ring_free(&p->rings[j]);
+			free(p->rings);
+			free(p);
+			return NULL;
+		}
+	}
+	return p;
+}
+
+void fecpipe_free(struct fecpipe *p)
+{
+	if (p == NULL)
+		return;
+	for (int i = 0; i < 2 * p->nworkers; i++)
+		ring_free(&p->rings[i]);
+	free(p->rings);
+	free(p);
+}
+
+// Run the whole stream through. Can only be run once per fecpipe.
+// The codec threads and the writer start first and wait for slots; if
+// any of them can't be started, those that did are stopped before a
+// byte is read and the run goes on this thread instead. Without a reader
+// thread, this thread reads.
+// returns bytes written, or -1
+long long fecpipe_run(struct fecpipe *p, FILE *in, FILE *out)
+{
+	int nw = p->nworkers;
+	pthread_t rd, wr, th[nw];
+	struct pipejob job[nw];
+
+	p->in = in;
+	p->out = out;
+	STAT_START(t0);
+	int started = 0, writer = 0;
+	for (; started < nw; started++)
+	{
+		job[started].p = p;
+		job[started].id = started;
+		if (pthread_create(&th[started], NULL, pipe_worker, &job[started]) != 0)
+			break;
+	}
+	if (started == nw)
+		writer = pthread_create(&wr, NULL, pipe_writer, p) == 0;
+
+	if (writer)
+	{
+		if (pthread_create(&rd, NULL, pipe_reader, p) != 0)
+			pipe_read(p);	// counted here, not in st[0]
+		else
+		{
+			pthread_join(rd, NULL);
+			stat_merge(&p->st[0]);
+		}
+		pthread_join(wr, NULL);
+		stat_merge(&p->st[1]);
+	}
+	else
+	{	// nothing read yet: let the workers go, then do it here
+		for (int i = 0; i < nw; i++)
+			ring_close(&p->rings[i]);
+	}
+	for (int i = 0; i < started; i++)
+	{
+		pthread_join(th[i], NULL);
+		stat_merge(&job[i].st);
+	}
+	if (!writer)
+		pipe_inline(p);
+	STAT_STOP(ST_PIPE, t0, 0, p->written, 0);
+	return atomic_load(&p->failed) ? -1 : (long long) p->written;
+}
+
+// Occupancy of each ring, safe to call while fecpipe_run is going.
+// occ[0 .. nworkers-1]: reader -> codec thread i
+// occ[nworkers .. 2*nworkers-1]: codec thread i -> writer
+// returns number of entries filled in
+int fecpipe_occ(struct fecpipe *p, struct fecocc *occ, int max)
+{
+	int n = 2 * p->nworkers < max ? 2 * p->nworkers : max;
+	for (int i = 0; i < n; i++)
+	{
+		struct fecring *r = &p->rings[i];
+		unsigned long t = atomic_load(&r->tail);
+		unsigned long h = atomic_load(&r->head);
+		occ[i].fill = (unsigned int) (h - t);
+		occ[i].nslots = r->nslots;
+		occ[i].hiwater = atomic_load(&r->hiwater);
+		occ[i].slots = h;
+		occ[i].fullwait = atomic_load(&r->fullwait);
+		occ[i].emptywait = atomic_load(&r->emptywait);
+	}
+	return n;
+}
+
+
+
+// Stages for the pipeline
+// arg carries the one parameter a codec needs (depth, secded), cast to a pointer.
+
+size_t fecblk_h74(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	(void) arg;
+	return h74blk_enc(in, len, out);
+}
+
+size_t fecblk_d_h74(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	(void) arg;
+	return h74blk_dec(in, len, out);
+}
+
+size_t fecblk_h74n(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	h74nblk_enc(arg != NULL, in, len, out);
+	return 2 * len;
+}
+
+size_t fecblk_d_h74n(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	h74nblk_dec(arg != NULL, in, len, out);
+	return len / 2;
+}
+
+// slots of 223*depth bytes
+size_t fecblk_rs255(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	int depth = (int) (intptr_t) arg;
+	size_t dlen = (size_t) 223 * depth;
+	memcpy(out, in, len);
+	memset(out + len, 0, dlen - len);
+	rsblk_enc(32, 255, depth, out);
+	return (size_t) 255 * depth;
+}
+
+// slots of 255*depth bytes; needs 255*depth bytes of out to work in
+size_t fecblk_d_rs255(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	int depth = (int) (intptr_t) arg;
+	size_t blen = (size_t) 255 * depth;
+	memcpy(out, in, len);
+	memset(out + len, 0, blen - len);
+	rsblk_dec(32, 255, depth, out, NULL, NULL);
+	return (size_t) 223 * depth;
+}
+
+// slots of a whole number of packets; arg is plen
+size_t fecblk_rnd(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t plen = (size_t) (intptr_t) arg;
+	if (plen == 0)
+		plen = len;
+	memcpy(out, in, len);
+	for (size_t o = 0; o < len; o += plen)
+		rndblk(out + o, len - o < plen ? len - o : plen);
+	return len;
+}
+
+// the same, leaving packets of all 0s (dropped) as they are
+size_t fecblk_d_rnd(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t plen = (size_t) (intptr_t) arg;
+	if (plen == 0)
+		plen = len;
+	memcpy(out, in, len);
+	for (size_t o = 0; o < len; o += plen)
+	{
+		size_t n = len - o < plen ? len - o : plen;
+		if (!rnd_zero(out + o, n))
+			rndblk(out + o, n);
+	}
+	return len;
+}
+
+// slots of one packet
+size_t fecblk_bilv(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	bilvblk((unsigned int) (intptr_t) arg, in, len, out);
+	return len;
+}
+
+size_t fecblk_d_bilv(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	d_bilvblk((unsigned int) (intptr_t) arg, in, len, out);
+	return len;
+}
+
+// slots of whole groups of 7*plen h74 codeword bytes; arg is plen. Like
+// inlvham, byte i*7+j of a group goes to packet j, position i; a short
+// last group is padded with 0s.
+size_t fecblk_ilvham(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t plen = plenof((unsigned int) (intptr_t) arg);
+	size_t glen = 7 * plen, o = 0;
+	for (; o < len; o += glen)
+	{
+		size_t n = len - o < glen ? len - o : glen;
+		memset(out + o, 0, glen);
+		for (size_t i = 0; i < n; i++)
+			out[o + (i % 7) * plen + i / 7] = in[o + i];
+	}
+	return o;
+}
+
+// slots of whole groups of 7 packets; arg is plen
+size_t fecblk_d_ilvham(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t plen = plenof((unsigned int) (intptr_t) arg);
+	size_t glen = 7 * plen, o = 0;
+	for (; o < len; o += glen)
+	{
+		size_t n = len - o < glen ? len - o : glen;
+		memset(out + o, 0, glen);
+		for (size_t i = 0; i < n; i++)
+			out[o + (i % plen) * 7 + i / plen] = in[o + i];
+	}
+	return o;
+}
+
+// slots of whole packets of data; arg is plen. Adds the UDP headers and
+// pads a short last packet with 0s (but no extra packet of 0s, as
+// inlvUDP adds when the data fills the last packet).
+size_t fecblk_udp(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t plen = plenof((unsigned int) (intptr_t) arg);
+	size_t o = 0;
+	for (size_t i = 0; i < len; i += plen, o += plen + 8)
+	{
+		size_t n = len - i < plen ? len - i : plen;
+		memset(out + o, 0xff, 4);
+		out[o + 4] = (unsigned char) plen;
+		out[o + 5] = (unsigned char) (plen >> 8);
+		out[o + 6] = 0x00;
+		out[o + 7] = 0x00;
+		memcpy(out + o + 8, in + i, n);
+		memset(out + o + 8 + n, 0, plen - n);
+	}
+	return o;
+}
+
+// slots of whole packets with headers; arg is plen. A packet the adapter
+// would drop comes out as 0s, like decUDP; a cut off packet at the end
+// comes out as nothing.
+size_t fecblk_d_udp(void *arg, const unsigned char *in, size_t len, unsigned char *out)
+{
+	size_t plen = plenof((unsigned int) (intptr_t) arg);
+	size_t o = 0;
+	for (const unsigned char *f = in; f + plen + 8 <= in + len; f += plen + 8, o += plen)
+	{
+		if (f[2] != 0xff || f[3] != 0xff)
+			STAT_ADD(drop_port, 1);
+		else if (f[4] != (unsigned char) plen || f[5] != (unsigned char) (plen >> 8))
+			STAT_ADD(drop_len, 1);
+		else if (f[6] != 0x00 || f[7] != 0x00)
+			STAT_ADD(drop_csum, 1);
+		else
+		{
+			memcpy(out + o, f + 8, plen);
+			continue;
+		}
+		memset(out + o, 0, plen);
+	}
+	return o;
+}
+
+
+
+
+/* STREAMS */
+
+/* The same stages, fed from whoever has the bytes: an event loop, a radio
+ * callback, a socket. fecstream_push() takes any amount of input,
+ * fecstream_pull() hands back whatever output is ready, and
+ * fecstream_flush() runs the short last slot of each stage at the end.
+ * Each stage keeps one slot of input between calls and runs as soon as
+ * the slot fills, so output is never more than one slot per stage behind
+ * the input, and pushes can be cut anywhere. Unlike fecpipe, each stage
+ * cuts its own slots, so stages with different slot sizes chain (rs255
+ * into h74 into ilvham, say) and the output is the same however the
+ * input was pushed.
+ */
+
+struct fecstream {
+	const struct fecstage *stages;
+	int nstages;
+	int flushed;
+	unsigned char **slot;	// input slot per stage
+	size_t *fill;		// bytes in each slot
+	unsigned char **out;	// output of each stage, until fed on
+	unsigned char *outq;	// output not pulled yet
+	size_t qhead, qtail, qsize;
+	size_t made;		// output of this push/flush, for stats
+};
+
+// Set up a stream through nstages stages (kept by reference).
+// returns NULL on bad input or no memory
+struct fecstream *fecstream_new(const struct fecstage *stages, int nstages)
+{
+	if (stages == NULL || nstages < 1)
+		return NULL;
+	gf_init();
+	hn_init();
+	rnd_init();
+	crc_init();
+
+	struct fecstream *s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		return NULL;
+	s->stages = stages;
+	s->nstages = nstages;
+	s->slot = calloc(nstages, sizeof(unsigned char *));
+	s->fill = calloc(nstages, sizeof(size_t));
+	s->out = calloc(nstages, sizeof(unsigned char *));
+	int bad = s->slot == NULL || s->fill == NULL || s->out == NULL;
+	for (int i = 0; i < nstages && !bad; i++)
+	{
+		if (stages[i].fn == NULL || stages[i].inlen == 0 || stages[i].outlen == 0)
+			bad = 1;
+		else if ((s->slot[i] = malloc(stages[i].inlen)) == NULL
+			|| (s->out[i] = malloc(stages[i].outlen)) == NULL)
+			bad = 1;
+	}
+	if (!bad)
+	{
+		s->qsize = stages[nstages - 1].outlen;
+		s->outq = malloc(s->qsize);
+	}
+	if (bad || s->outq == NULL)
+	{
+		fecstream_free(s);
+		return NULL;
+	}
+	return s;
+}
+
+void fecstream_free(struct fecstream *s)
+{
+	if (s == NULL)
+		return;
+	for (int i = 0; i < s->nstages; i++)
+	{
+		if (s->slot != NULL)
+			free(s->slot[i]);
+		if (s->out != NULL)
+			free(s->out[i]);
+	}
+	free(s->slot);
+	free(s->fill);
+	free(s->out);
+	free(s->outq);
+	free(s);
+}
+
+// Append to the output queue, growing it if nobody is pulling
+static int fs_queue(struct fecstream *s, const unsigned char *p, size_t len)
+{
+	if (s->qtail + len > s->qsize && s->qhead > 0)
+	{
+		memmove(s->outq, s->outq + s->qhead, s->qtail - s->qhead);
+		s->qtail -= s->qhead;
+		s->qhead = 0;
+	}
+	if (s->qtail + len > s->qsize)
+	{
+		size_t n = s->qsize;
+		while (s->qtail + len > n)
+			n *= 2;
+		unsigned char *q = realloc(s->outq, n);
+		if (q == NULL)
+			return -1;
+		s->outq = q;
+		s->qsize = n;
+	}
+	memcpy(s->outq + s->qtail, p, len);
+	s->qtail += len;
+	s->made += len;
+	return 0;
+}
+
+// Feed len bytes to stage i, running it on each full slot
+static int fs_feed(struct fecstream *s, int i, const unsigned char *p, size_t len)
+{
+	if (i == s->nstages)
+		return fs_queue(s, p, len);
+
+	const struct fecstage *st = &s->stages[i];
+	while (len > 0)
+	{
+		size_t n = st->inlen - s->fill[i];
+		if (n > len)
+			n = len;
+		// a whole slot straight from the caller needs no copy
+		const unsigned char *src = p;
+		if (s->fill[i] > 0 || n < st->inlen)
+		{
+			memcpy(s->slot[i] + s->fill[i], p, n);
+			src = s->slot[i];
+		}
+		s->fill[i] += n;
+		p += n;
+		len -= n;
+		if (s->fill[i] == st->inlen)
+		{
+			s->fill[i] = 0;
+			size_t olen = st->fn(st->arg, src, st->inlen, s->out[i]);
+			if (fs_feed(s, i + 1, s->out[i], olen) < 0)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+// Push len bytes of input.
+// returns 0, or -1 after fecstream_flush() or with no memory
+int fecstream_push(struct fecstream *s, const void *in, size_t len)
+{
+	if (s->flushed)
+		return -1;
+	STAT_START(t0);
+	int r = fs_feed(s, 0, in, len);
+	STAT_STOP(ST_STREAM, t0, len, s->made, 0);
+	s->made = 0;
+	return r;
+}
+
+// End of input: run what is left in each stage's slot, in order.
+// returns 0, or -1 with no memory
+int fecstream_flush(struct fecstream *s)
+{
+	if (s->flushed)
+		return 0;
+	s->flushed = 1;
+	STAT_START(t0);
+	for (int i = 0; i < s->nstages; i++)
+	{
+		if (s->fill[i] == 0)
+			continue;
+		const struct fecstage *st = &s->stages[i];
+		size_t olen = st->fn(st->arg, s->slot[i], s->fill[i], s->out[i]);
+		s->fill[i] = 0;
+		if (fs_feed(s, i + 1, s->out[i], olen) < 0)
+			return -1;
+	}
+	STAT_STOP(ST_STREAM, t0, 0, s->made, 0);
+	s->made = 0;
+	return 0;
+}
+
+// Take up to max bytes of output.
+// returns bytes copied (0: nothing ready)
+size_t fecstream_pull(struct fecstream *s, void *out, size_t max)
+{
+	size_t n = s->qtail - s->qhead;
+	if (n > max)
+		n = max;
+	memcpy(out, s->outq + s->qhead, n);
+	s->qhead += n;
+	if (s->qhead == s->qtail)
+		s->qhead = s->qtail = 0;
+	return n;
+}
+
+// Bytes ready to pull
+size_t fecstream_ready(const struct fecstream *s)
+{
+	return s->qtail - s->qhead;
+}
+
+
+
+
+/* MAPPED FILES */
+
+/* File to file versions of the codecs for archives too big for the int
+ * counts above. Input and output are mmap'ed, the kernel is told both are
+ * read/written front to back, and the block codecs write straight into
+ * the output mapping. Sizes and counts are 64 bit throughout.
+ */
+
+// Map a whole file for reading. *len = 0 and NULL for an empty file.
+// returns -1 on error, else the fd
+static int map_in(const char *path, unsigned char **p, uint64_t *len)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat sb;
+
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &sb) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	*len = (uint64_t) sb.st_size;
+	*p = NULL;
+	if (*len == 0)
+		return fd;
+	*p = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (*p == MAP_FAILED)
+	{
+		close(fd);
+		return -1;
+	}
+	madvise(*p, *len, MADV_SEQUENTIAL);
+	return fd;
+}
+
+// Create path with room for len bytes and map it for writing
+// returns -1 on error, else the fd
+static int map_out(const char *path, unsigned char **p, uint64_t len)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, (off_t) len) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	*p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (*p == MAP_FAILED)
+	{
+		close(fd);
+		return -1;
+	}
+	madvise(*p, len, MADV_SEQUENTIAL);
+	return fd;
+}
+
+// Unmap both, cut the output down to what was written
+static int map_done(int ifd, unsigned char *ip, uint64_t ilen,
+	int ofd, unsigned char *op, uint64_t olen, uint64_t written)
+{
+	int ret = 0;
+
+	if (ip != NULL)
+		munmap(ip, ilen);
+	close(ifd);
+	if (munmap(op, olen) < 0 || ftruncate(ofd, (off_t) written) < 0)
+		ret = -1;
+	if (close(ofd) < 0)
+		ret = -1;
+	return ret;
+}
+
+// Run one stage (see fecstage) over a file: inlen bytes at a time, the
+// last block short. Every block's output lands directly in the output
+// mapping except a final one that doesn't fit in what's left of it.
+// returns bytes written, or -1
+long long fecmap(const struct fecstage *st, const char *inpath, const char *outpath)
+{
+	unsigned char *in, *out;
+	uint64_t ilen, written = 0;
+
+	if (st == NULL || st->inlen == 0 || st->outlen == 0)
+		return -1;
+	gf_init();
+	hn_init();
+	rnd_init();
+	crc_init();
+
+	int ifd = map_in(inpath, &in, &ilen);
+	if (ifd < 0)
+		return -1;
+	uint64_t nblk = (ilen + st->inlen - 1) / st->inlen;
+	uint64_t cap = nblk * st->outlen;
+	int ofd = map_out(outpath, &out, cap ? cap : 1);
+	if (ofd < 0)
+	{
+		if (in != NULL)
+			munmap(in, ilen);
+		close(ifd);
+		return -1;
+	}
+
+	STAT_START(t0);
+	for (uint64_t b = 0; b < nblk; b++)
+	{
+		uint64_t off = b * st->inlen;
+		size_t len = ilen - off < st->inlen ? (size_t) (ilen - off) : st->inlen;
+
+		if (cap - written >= st->outlen)
+			written += st->fn(st->arg, in + off, len, out + written);
+		else
+		{	// only the last block of a shrinking code gets here
+			unsigned char *tmp = malloc(st->outlen);
+			if (tmp == NULL)
+				break;
+			size_t n = st->fn(st->arg, in + off, len, tmp);
+			memcpy(out + written, tmp, n);
+			written += n;
+			free(tmp);
+		}
+	}
+	STAT_STOP(ST_MAP, t0, ilen, written, nblk);
+
+	if (map_done(ifd, in, ilen, ofd, out, cap ? cap : 1, written) < 0)
+		return -1;
+	return (long long) written;
+}
+
+// inlvUDP on files: same output, byte for byte
+// returns number of packets, or -1
+long long fecmap_udp(unsigned int length, const char *inpath, const char *outpath)
+{
+	length = plenof(length);
+	unsigned char *in, *out;
+	uint64_t ilen;
+
+	if (length > 65535 || length < 8)
+		return -1;
+	int ifd = map_in(inpath, &in, &ilen);
+	if (ifd < 0)
+		return -1;
+	// like inlvUDP, a last packet of 0s when the data fills the one before
+	uint64_t pcount = ilen / length + 1;
+	uint64_t olen = pcount * (length + 8);
+	int ofd = map_out(outpath, &out, olen);
+	if (ofd < 0)
+	{
+		if (in != NULL)
+			munmap(in, ilen);
+		close(ifd);
+		return -1;
+	}
+
+	STAT_START(t0);
+	unsigned char *o = out;
+	for (uint64_t p = 0; p < pcount; p++, o += length + 8)
+	{
+		uint64_t off = p * length;
+		size_t n = ilen - off < length ? (size_t) (ilen - off) : length;
+
+		memset(o, 0xff, 4);
+		o[4] = (unsigned char) length;
+		o[5] = (unsigned char) (length >> 8);
+		o[6] = 0x00;
+		o[7] = 0x00;
+		if (n)	// an empty file isn't mapped
+			memcpy(o + 8, in + off, n);
+		memset(o + 8 + n, 0, length - n);
+	}
+	STAT_STOP(ST_INLVUDP, t0, pcount * length, olen, pcount);
+
+	if (map_done(ifd, in, ilen, ofd, out, olen, olen) < 0)
+		return -1;
+	return (long long) pcount;
+}
+
+// decUDP on files. The packet count comes from the file size.
+// dropped (if not NULL) gets the number of packets dropped.
+// returns number of packets, or -1
+long long fecmap_d_udp(unsigned int plen, const char *inpath, const char *outpath,
+	uint64_t *dropped)
+{
+	plen = plenof(plen);
+	unsigned char *in, *out;
+	uint64_t ilen, drops = 0;
+
+	if (plen > 65535 || plen < 8)
+		return -1;
+	int ifd = map_in(inpath, &in, &ilen);
+	if (ifd < 0)
+		return -1;
+	uint64_t pnum = ilen / (plen + 8);
+	uint64_t olen = pnum * plen;
+	int ofd = map_out(outpath, &out, olen ? olen : 1);
+	if (ofd < 0)
+	{
+		if (in != NULL)
+			munmap(in, ilen);
+		close(ifd);
+		return -1;
+	}
+
+	STAT_START(t0);
+	const unsigned char *f = in;
+	for (uint64_t p = 0; p < pnum; p++, f += plen + 8)
+	{
+		int bad = 1;
+
+		if (f[2] != 0xff || f[3] != 0xff)
+			STAT_ADD(drop_port, 1);
+		else if (f[4] != (unsigned char) plen || f[5] != (unsigned char) (plen >> 8))
+			STAT_ADD(drop_len, 1);
+		else if (f[6] != 0x00 || f[7] != 0x00)
+			STAT_ADD(drop_csum, 1);
+		else
+			bad = 0;
+
+		if (bad)
+		{
+			memset(out + p * plen, 0, plen);
+			drops++;
+		}
+		else
+			memcpy(out + p * plen, f + 8, plen);
+	}
+	STAT_STOP(ST_DECUDP, t0, ilen, olen, pnum);
+
+	if (dropped != NULL)
+		*dropped = drops;
+	if (map_done(ifd, in, ilen, ofd, out, olen ? olen : 1, olen) < 0)
+		return -1;
+	return (long long) pnum;
+}
+
+
+
+
+/* BATCH ENCODER */
+
+/* Encodes a queue of files at once and sends them as one packet stream.
+ * Worker threads take files in priority order and encode them with each
+ * file's own stage; the calling thread sends packets, always from the
+ * highest priority file that has a packet ready, so the radio is never
+ * waiting on an encoder while any file has data.
+ *
+ * Each packet is a UDP header plus a 12 byte stream header:
+ *   sid (16 bit), seq (32 bit), used (15 bit) | last (bit 15),
+ *   CRC-32C of those 8 bytes
+ * then plen bytes of payload, of which the first "used" are data.
+ * Everything little endian. demux() splits a stream back into files.
+ * The payload isn't covered by the CRC, so bit errors in it still reach
+ * the file's own decoder, but a bad seq or used can't put the rest of a
+ * file in the wrong place.
+ */
+
+#define BATCH_HDR	12
+#define BATCH_LAST	0x8000
+#define BATCH_QUEUE	256	// packets buffered per file before its encoder waits
+
+struct batchq {
+	unsigned char *buf;	// encoded, not yet sent
+	size_t pos, len, cap;
+	int started, done;
+	int sent;		// last packet has gone out
+	uint32_t seq;
+};
+
+struct batch {
+	struct fecjob *jobs;
+	struct batchq *q;
+	int njobs;
+	unsigned int plen;
+	int unbounded;		// no worker threads: encode everything first
+	pthread_mutex_t lock;
+	pthread_cond_t more;	// data was added (or a file finished)
+	pthread_cond_t room;	// data was sent
+};
+
+// Append n encoded bytes to file j, waiting while its queue is full
+static int batch_put(struct batch *b, int j, const unsigned char *p, size_t n)
+{
+	struct batchq *q = &b->q[j];
+	size_t limit = (size_t) BATCH_QUEUE * b->plen;
+
+	pthread_mutex_lock(&b->lock);
+	while (!b->unbounded && q->len - q->pos > limit)
+		pthread_cond_wait(&b->room, &b->lock);
+	if (q->pos > 0 && q->pos >= q->cap / 2)
+	{
+		memmove(q->buf, q->buf + q->pos, q->len - q->pos);
+		q->len -= q->pos;
+		q->pos = 0;
+	}
+	if (q->len + n > q->cap)
+	{
+		size_t cap = q->cap ? q->cap : 4 * (size_t) b->plen;
+		while (cap < q->len + n)
+			cap *= 2;
+		unsigned char *nb = realloc(q->buf, cap);
+		if (nb == NULL)
+		{
+			pthread_mutex_unlock(&b->lock);
+			return -1;
+		}
+		q->buf = nb;
+		q->cap = cap;
+	}
+	memcpy(q->buf + q->len, p, n);
+	q->len += n;
+	pthread_cond_signal(&b->more);
+	pthread_mutex_unlock(&b->lock);
+	return 0;
+}
+
+static void batch_encode(struct batch *b, int j)
+{
+	struct fecjob *job = &b->jobs[j];
+	const struct fecstage *st = &job->st;
+	size_t inlen = st->fn != NULL ? st->inlen : b->plen;
+	unsigned char *in, *tmp = NULL;
+	uint64_t ilen;
+
+	int fd = map_in(job->path, &in, &ilen);
+	if (fd < 0)
+	{
+		job->err = -1;
+		return;
+	}
+	if (st->fn != NULL && (tmp = malloc(st->outlen)) == NULL)
+		job->err = -1;
+	for (uint64_t off = 0; off < ilen && !job->err; off += inlen)
+	{
+		size_t n = ilen - off < inlen ? (size_t) (ilen - off) : inlen;
+		const unsigned char *p = in + off;
+		if (tmp != NULL)
+		{
+			n = st->fn(st->arg, p, n, tmp);
+			p = tmp;
+		}
+		if (batch_put(b, j, p, n) < 0)
+			job->err = -1;
+	}
+	free(tmp);
+	if (in != NULL)
+		munmap(in, ilen);
+	close(fd);
+}
+
+static void *batch_worker(void *arg)
+{
+	struct batch *b = arg;
+	struct fecstats st;
+
+	if (!b->unbounded) // else we're on the caller's thread
+	{
+		memset(&st, 0, sizeof(st));
+		fecstats_use(&st);
+	}
+	for (;;)
+	{
+		// highest priority file nobody has taken yet
+		int j = -1;
+		pthread_mutex_lock(&b->lock);
+		for (int i = 0; i < b->njobs; i++)
+			if (!b->q[i].started && (j < 0 || b->jobs[i].prio > b->jobs[j].prio))
+				j = i;
+		if (j >= 0)
+			b->q[j].started = 1;
+		pthread_mutex_unlock(&b->lock);
+		if (j < 0)
+			break;
+
+		batch_encode(b, j);
+
+		pthread_mutex_lock(&b->lock);
+		b->q[j].done = 1;
+		pthread_cond_signal(&b->more);
+		pthread_mutex_unlock(&b->lock);
+	}
+	if (!b->unbounded)
+	{
+		fecstats_use(NULL);
+		pthread_mutex_lock(&b->lock);
+		stat_merge(&st);
+		pthread_mutex_unlock(&b->lock);
+	}
+	return NULL;
+}
+
+static void batch_hdr(unsigned char *pkt, unsigned int sid, uint32_t seq, unsigned int used)
+{
+	pkt[0] = (unsigned char) sid;
+	pkt[1] = (unsigned char) (sid >> 8);
+	pkt[2] = (unsigned char) seq;
+	pkt[3] = (unsigned char) (seq >> 8);
+	pkt[4] = (unsigned char) (seq >> 16);
+	pkt[5] = (unsigned char) (seq >> 24);
+	pkt[6] = (unsigned char) used;
+	pkt[7] = (unsigned char) (used >> 8);
+	uint32_t crc = crc32c(0, pkt, 8);
+	pkt[8] = (unsigned char) crc;
+	pkt[9] = (unsigned char) (crc >> 8);
+	pkt[10] = (unsigned char) (crc >> 16);
+	pkt[11] = (unsigned char) (crc >> 24);
+}
+
+// Take the next packet off file j's queue into pkt (header included)
+// called with the lock held. A file that failed part way gets no last
+// packet, so demux reports it as cut short.
+static void batch_take(struct batch *b, int j, unsigned char *pkt)
+{
+	struct batchq *q = &b->q[j];
+	size_t n = q->len - q->pos < b->plen ? q->len - q->pos : b->plen;
+	unsigned int used = (unsigned int) n;
+
+	if (q->done && n == q->len - q->pos)
+	{
+		if (!b->jobs[j].err)
+			used |= BATCH_LAST;
+		q->sent = 1;
+	}
+	batch_hdr(pkt, b->jobs[j].sid, q->seq, used);
+	memcpy(pkt + BATCH_HDR, q->buf + q->pos, n);
+	memset(pkt + BATCH_HDR + n, 0, b->plen - n);
+	q->pos += n;
+	q->seq++;
+}
+
+// Encode and send njobs files as one stream of packets with plen bytes
+// of payload each (plus the 12 byte stream header), using nthreads encoders.
+// A job with st.fn == NULL is sent as is. jobs[i].packets and
+// jobs[i].err are filled in; a file that can't be read sends nothing.
+// returns packets written, or -1 (also for a sid over 65535)
+long long batchenc(struct fecjob *jobs, int njobs, unsigned int plen,
+	int nthreads, FILE *out)
+{
+	plen = plenof(plen);
+	if (jobs == NULL || njobs < 1 || nthreads < 1
+		|| plen < 1 || plen >= BATCH_LAST || plen + BATCH_HDR > 65535)
+		return -1;
+	for (int i = 0; i < njobs; i++)
+		if (jobs[i].sid > 65535)
+			return -1;
+	gf_init();
+	hn_init();
+	rnd_init();
+	crc_init();
+
+	struct batch b;
+	b.jobs = jobs;
+	b.njobs = njobs;
+	b.plen = plen;
+	b.unbounded = 0;
+	b.q = calloc(njobs, sizeof(struct batchq));
+	unsigned char *pkt = malloc(plen + BATCH_HDR);
+	if (b.q == NULL || pkt == NULL)
+	{
+		free(b.q);
+		free(pkt);
+		return -1;
+	}
+	for (int i = 0; i < njobs; i++)
+	{
+		jobs[i].packets = 0;
+		jobs[i].err = 0;
+	}
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.more, NULL);
+	pthread_cond_init(&b.room, NULL);
+
+	STAT_START(t0);
+	pthread_t th[nthreads];
+	int started = 0;
+	for (; started < nthreads; started++)
+		if (pthread_create(&th[started], NULL, batch_worker, &b) != 0)
+			break;
+	if (started == 0)
+	{	// no threads: encode it all here, then send
+		b.unbounded = 1;
+		batch_worker(&b);
+	}
+
+	long long sent = 0;
+	pthread_mutex_lock(&b.lock);
+	for (;;)
+	{
+		// highest priority file with a full packet, or its last one
+		int j = -1, left = 0;
+		for (int i = 0; i < njobs; i++)
+		{
+			struct batchq *q = &b.q[i];
+			size_t have = q->len - q->pos;
+			if (q->done && jobs[i].err && have == 0)
+				q->sent = 1;	// nothing (more) to send
+			if (q->sent)
+				continue;
+			left = 1;
+			if ((have >= plen || q->done)
+				&& (j < 0 || jobs[i].prio > jobs[j].prio))
+				j = i;
+		}
+		if (!left)
+			break;
+		if (j < 0)
+		{
+			pthread_cond_wait(&b.more, &b.lock);
+			continue;
+		}
+		batch_take(&b, j, pkt);
+		pthread_cond_broadcast(&b.room);
+		pthread_mutex_unlock(&b.lock);
+
+		addUDP(plen + BATCH_HDR, out);
+		fwrite(pkt, 1, plen + BATCH_HDR, out);
+		jobs[j].packets++;
+		sent++;
+
+		pthread_mutex_lock(&b.lock);
+	}
+	pthread_mutex_unlock(&b.lock);
+
+	for (int i = 0; i < started; i++)
+		pthread_join(th[i], NULL);
+	STAT_STOP(ST_BATCH, t0, 0, (unsigned long long) sent * (plen + BATCH_HDR + 8), sent);
+
+	pthread_mutex_destroy(&b.lock);
+	pthread_cond_destroy(&b.more);
+	pthread_cond_destroy(&b.room);
+	for (int i = 0; i < njobs; i++)
+		free(b.q[i].buf);
+	free(b.q);
+	free(pkt);
+	return sent;
+}
+
+// Flag packet i of a stream in its erasure map, growing it as needed
+static int demux_flag(unsigned char **eras, uint64_t *n, uint64_t *cap, int flag)
+{
+	if (*n == *cap)
+	{
+		uint64_t ncap = *cap ? 2 * *cap : 256;
+		unsigned char *e = realloc(*eras, ncap);
+		if (e == NULL)
+			return -1;
+		*eras = e;
+		*cap = ncap;
+	}
+	(*eras)[(*n)++] = (unsigned char) flag;
+	return 0;
+}
+
+// demux, and if eras is not NULL, eras[sid] is set to a malloc'd map
+// with one flag per packet written to outs[sid] (1 = lost, filled with
+// 0s), neras[sid] entries long, for d_rskm and the other erasure
+// decoders: unlike their all-0s guess, it doesn't take the 0 packets
+// rskm pads a group with for lost ones. Free the maps when done.
+// returns packets read, or -1
+long long demuxe(unsigned int plen, FILE *in, FILE **outs, int nouts, uint64_t *lost,
+	unsigned char *ended, unsigned char **eras, uint64_t *neras)
+{
+	plen = plenof(plen);
+	if (plen < 1 || plen >= BATCH_LAST || plen + BATCH_HDR > 65535 || nouts < 1)
+		return -1;
+
+	unsigned int ulen = plen + BATCH_HDR;
+	unsigned char *frame = malloc(ulen + 8);
+	uint32_t *next = calloc(nouts, sizeof(uint32_t));
+	unsigned char *fin = calloc(nouts, 1);	// last packet has come
+	unsigned char *zero = calloc(1, plen);
+	uint64_t *cap = calloc(nouts, sizeof(uint64_t));
+	long long pnum = 0;
+
+	if (eras != NULL)
+	{
+		memset(eras, 0, nouts * sizeof(*eras));
+		memset(neras, 0, nouts * sizeof(*neras));
+	}
+	if (frame == NULL || next == NULL || fin == NULL || zero == NULL || cap == NULL)
+	{
+		pnum = -1;
+		goto done;
+	}
+	if (lost != NULL)
+		memset(lost, 0, nouts * sizeof(uint64_t));
+
+	STAT_START(t0);
+	while (fread(frame, 1, ulen + 8, in) == ulen + 8)
+	{
+		pnum++;
+		if (frame[2] != 0xff || frame[3] != 0xff)
+		{
+			STAT_ADD(drop_port, 1);
+			continue;
+		}
+		if (frame[4] != (unsigned char) ulen || frame[5] != (unsigned char) (ulen >> 8))
+		{
+			STAT_ADD(drop_len, 1);
+			continue;
+		}
+		if (frame[6] != 0x00 || frame[7] != 0x00)
+		{
+			STAT_ADD(drop_csum, 1);
+			continue;
+		}
+
+		const unsigned char *h = frame + 8;
+		uint32_t crc = h[8] | h[9] << 8 | h[10] << 16 | (uint32_t) h[11] << 24;
+		if (crc32c(0, h, 8) != crc)
+		{
+			STAT_ADD(drop_crc, 1);
+			continue;
+		}
+		unsigned int sid = h[0] | h[1] << 8;
+		uint32_t seq = h[2] | h[3] << 8 | h[4] << 16 | (uint32_t) h[5] << 24;
+		unsigned int used = (h[6] | h[7] << 8) & ~BATCH_LAST;
+		int last = (h[6] | h[7] << 8) & BATCH_LAST;
+
+		// only the last packet of a stream is short
+		if (sid >= (unsigned int) nouts || outs[sid] == NULL || fin[sid]
+			|| seq < next[sid] || used > plen || (!last && used != plen))
+			continue;
+		if (last)
+			fin[sid] = 1;
+		for (; next[sid] < seq; next[sid]++)
+		{	// the packets in between never made it
+			fwrite(zero, 1, plen, outs[sid]);
+			if (lost != NULL)
+				lost[sid]++;
+			if (eras != NULL && demux_flag(&eras[sid], &neras[sid], &cap[sid], 1) < 0)
+				pnum = -1;
+		}
+		fwrite(h + BATCH_HDR, 1, used, outs[sid]);
+		if (eras != NULL && demux_flag(&eras[sid], &neras[sid], &cap[sid], 0) < 0)
+			pnum = -1;
+		next[sid] = seq + 1;
+		if (pnum < 0)
+			break;
+	}
+	STAT_STOP(ST_BATCH, t0, pnum > 0 ? (unsigned long long) pnum * (ulen + 8) : 0, 0,
+		pnum > 0 ? pnum : 0);
+
+	if (ended != NULL)
+		memcpy(ended, fin, nouts);
+done:
+	if (pnum < 0 && eras != NULL)
+		for (int s = 0; s < nouts; s++)
+		{
+			free(eras[s]);
+			eras[s] = NULL;
+			neras[s] = 0;
+		}
+	free(frame);
+	free(next);
+	free(fin);
+	free(zero);
+	free(cap);
+	return pnum;
+}
+
+// Split a batchenc stream back into files: stream sid goes to outs[sid]
+// (streams with sid >= nouts or outs[sid] == NULL are skipped). Packets
+// dropped by the UDP header check or the stream header CRC, or missing
+// from a stream's sequence, come out as plen 0s, like decUDP. lost[sid]
+// (if lost is not NULL) counts them. ended[sid] (if ended is not NULL) is
+// 1 if the stream's last packet came; 0 means the file was cut short (or
+// never seen), and whatever was lost after the last packet that came is
+// not in lost[sid].
+// returns packets read, or -1
+long long demux(unsigned int plen, FILE *in, FILE **outs, int nouts, uint64_t *lost,
+	unsigned char *ended)
+{
+	return demuxe(plen, in, outs, nouts, lost, ended, NULL, NULL);
+}
+
+
+
+
+/* DECODER SESSIONS */
+
+/* Keeps what has arrived of an rskm stream in a file, so a file that
+ * didn't decode in one pass can be finished on the next instead of
+ * starting over. The file is mapped, so every packet added is on disk
+ * as soon as the kernel writes the page back (sess_close syncs it).
+ *
+ * A group only ever needs k of its k+m packets, so each group keeps k
+ * slots: data packet j goes in slot j, parity packets fill the slots
+ * of data packets that haven't come. Once a group has k packets it is
+ * decoded in place and the rest of its packets are ignored. Layout:
+ *
+ *   header   struct sesshdr, 64 bytes
+ *   group 0  have[(k+m+7)/8]  bit i set: packet i has come
+ *            slot[k]          packet in each slot, 0xff empty
+ *            done             1 once decoded
+ *            (pad to 8)
+ *            data[k][plen]
+ *   group 1  ...
+ */
+
+#define SESS_MAGIC	0x53434546	// "FECS"
+#define SESS_EMPTY	0xff
+
+struct sesshdr {
+	uint32_t magic;
+	uint32_t k, m, plen;
+	uint64_t ngroups;	// groups the file has room for
+	uint64_t hi;		// 1 + highest group seen
+	uint64_t complete;	// groups decoded
+	unsigned char pad[24];
+};
+
+struct fecsess {
+	int fd;
+	unsigned char *map;
+	uint64_t maplen;
+	int k, m, n;
+	unsigned int plen;
+	size_t meta;		// bytes before the data in a group
+	size_t rec;		// bytes per group
+	struct sesshdr *h;
+};
+
+static inline unsigned char *sess_grp(struct fecsess *s, uint64_t g)
+{
+	return s->map + sizeof(struct sesshdr) + g * s->rec;
+}
+
+// Make room for at least ngroups groups
+static int sess_grow(struct fecsess *s, uint64_t ngroups)
+{
+	uint64_t old = s->h->ngroups;
+	uint64_t len = sizeof(struct sesshdr) + ngroups * s->rec;
+
+	if (ngroups <= old)
+		return 0;
+	if (ftruncate(s->fd, (off_t) len) < 0)
+		return -1;
+	munmap(s->map, s->maplen);
+	s->map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if (s->map == MAP_FAILED)
+	{
+		s->map = NULL;
+		return -1;
+	}
+	s->maplen = len;
+	s->h = (struct sesshdr *) s->map;
+	// new groups: nothing has come (the file extends with 0s)
+	for (uint64_t g = old; g < ngroups; g++)
+		memset(sess_grp(s, g) + (s->n + 7) / 8, SESS_EMPTY, s->k);
+	s->h->ngroups = ngroups;
+	return 0;
+}
+
+// Open the session in path, or start one if there's no such file.
+// k, m and plen must match an existing session (or k = 0 to take
+// whatever it has).
+// returns NULL on error or mismatch
+struct fecsess *sess_open(const char *path, int k, int m, unsigned int plen)
+{
+	plen = plenof(plen);
+	struct fecsess *s = calloc(1, sizeof(*s));
+	struct stat sb;
+	int made = 0;		// the file is ours to remove on failure
+
+	if (s == NULL)
+		return NULL;
+	gf_init();
+	s->fd = open(path, O_RDWR);
+	if (s->fd < 0 && errno == ENOENT)
+	{
+		s->fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+		made = s->fd >= 0;
+	}
+	if (s->fd < 0 || fstat(s->fd, &sb) < 0)
+		goto fail;
+
+	struct sesshdr h;
+	if (sb.st_size == 0)
+	{	// new session
+		if (k < 1 || m < 0 || k + m > 255 || plen == 0 || plen > 65535)
+			goto fail;
+		memset(&h, 0, sizeof(h));
+		h.magic = SESS_MAGIC;
+		h.k = k;
+		h.m = m;
+		h.plen = plen;
+		if (pwrite(s->fd, &h, sizeof(h), 0) != sizeof(h))
+			goto fail;
+		sb.st_size = sizeof(h);
+	}
+	else if (pread(s->fd, &h, sizeof(h), 0) != sizeof(h) || h.magic != SESS_MAGIC
+		|| (k != 0 && (h.k != (uint32_t) k || h.m != (uint32_t) m || h.plen != plen)))
+		goto fail;
+
+	s->k = h.k;
+	s->m = h.m;
+	s->n = h.k + h.m;
+	s->plen = h.plen;
+	s->meta = ((s->n + 7) / 8 + s->k + 1 + 7) & ~(size_t) 7;
+	s->rec = s->meta + (size_t) s->k * s->plen;
+	if ((uint64_t) sb.st_size < sizeof(h) + h.ngroups * s->rec)
+		goto fail;
+	s->maplen = (uint64_t) sb.st_size;
+	s->map = mmap(NULL, s->maplen, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if (s->map == MAP_FAILED)
+		goto fail;
+	s->h = (struct sesshdr *) s->map;
+	return s;
+
+fail:
+	if (s->fd >= 0)
+		close(s->fd);
+	if (made)	// no half made session for the next sess_open to trip on
+		unlink(path);
+	free(s);
+	return NULL;
+}
+
+// Decode group g in place from the k packets in its slots
+static int sess_fix(struct fecsess *s, uint64_t g)
+{
+	unsigned char *r = sess_grp(s, g);
+	unsigned char *slot = r + (s->n + 7) / 8;
+	unsigned char *data = r + s->meta;
+	unsigned char lost[255];
+	int ret = 0;
+
+	memset(lost, 1, s->n);
+	for (int j = 0; j < s->k; j++)
+		lost[slot[j]] = 0;
+
+	// only needs rebuilding if some slot holds parity
+	int parity = 0;
+	for (int j = 0; j < s->k; j++)
+		parity |= slot[j] != j;
+	if (parity)
+	{
+		unsigned char *packet = calloc(s->n, s->plen);
+		if (packet == NULL)
+			return -1;
+		for (int j = 0; j < s->k; j++)
+			memcpy(packet + (size_t) slot[j] * s->plen, data + (size_t) j * s->plen, s->plen);
+		ret = rskm_fix(s->k, s->m, s->plen, packet, lost);
+		if (ret >= 0)
+			memcpy(data, packet, (size_t) s->k * s->plen);
+		free(packet);
+		if (ret < 0)
+			return -1;
+		STAT_ADD(rsfix, ret);
+	}
+	for (int j = 0; j < s->k; j++)
+		slot[j] = (unsigned char) j;
+	slot[s->k] = 1;
+	s->h->complete++;
+	return ret;
+}
+
+// Add packet number pidx of the stream (group pidx / (k+m)).
+// returns 0 if it wasn't needed, 1 if kept, 2 if it completed its group,
+// -1 on error
+int sess_add(struct fecsess *s, uint64_t pidx, const unsigned char *pkt)
+{
+	uint64_t g = pidx / s->n;
+	int i = (int) (pidx % s->n);
+
+	if (g >= s->h->ngroups)
+	{
+		uint64_t want = 2 * s->h->ngroups;
+		if (sess_grow(s, want > g ? want : g + 1) < 0)
+			return -1;
+	}
+	if (g >= s->h->hi)
+		s->h->hi = g + 1;
+
+	unsigned char *r = sess_grp(s, g);
+	unsigned char *have = r;
+	unsigned char *slot = r + (s->n + 7) / 8;
+	unsigned char *data = r + s->meta;
+
+	if (slot[s->k] || (have[i / 8] >> (i % 8) & 1))
+		return 0;
+
+	int to;
+	if (i < s->k)
+	{
+		to = i;
+		if (slot[i] != SESS_EMPTY)
+		{	// a parity packet is standing in: move it
+			int f = 0;
+			while (slot[f] != SESS_EMPTY)
+				f++;
+			memcpy(data + (size_t) f * s->plen, data + (size_t) i * s->plen, s->plen);
+			slot[f] = slot[i];
+		}
+	}
+	else
+	{
+		to = 0;
+		while (slot[to] != SESS_EMPTY)
+			to++;
+	}
+	memcpy(data + (size_t) to * s->plen, pkt, s->plen);
+	slot[to] = (unsigned char) i;
+	have[i / 8] |= 1 << (i % 8);
+
+	// full up? (there is always an empty slot until then)
+	for (int j = 0; j < s->k; j++)
+		if (slot[j] == SESS_EMPTY)
+			return 1;
+	return sess_fix(s, g) < 0 ? -1 : 2;
+}
+
+// Add pnum packets from a decUDP / decUDPcrc output stream, the first
+// being packet number first. Erased packets (eras[i] nonzero, or all 0s
+// when eras is NULL) are skipped.
+// returns number of packets kept, or -1
+long long sess_addstream(struct fecsess *s, uint64_t first, uint64_t pnum,
+	const unsigned char *eras, FILE *in)
+{
+	unsigned char *pkt = malloc(s->plen);
+	long long kept = 0;
+
+	if (pkt == NULL)
+		return -1;
+	STAT_START(t0);
+	for (uint64_t p = 0; p < pnum; p++)
+	{
+		if (fread(pkt, 1, s->plen, in) != s->plen)
+			break;
+		int lost;
+		if (eras != NULL)
+			lost = eras[p] != 0;
+		else
+		{
+			unsigned char superzip = 0x00;
+			for (unsigned int b = 0; b < s->plen; b++)
+				superzip |= pkt[b];
+			lost = superzip == 0x00;
+		}
+		if (lost)
+			continue;
+		int r = sess_add(s, first + p, pkt);
+		if (r < 0)
+		{
+			kept = -1;
+			break;
+		}
+		kept += r > 0;
+	}
+	STAT_STOP(ST_SESS, t0, pnum * s->plen, 0, pnum);
+	free(pkt);
+	return kept;
+}
+
+// What group g still needs: want[i] (k+m entries, if want is not NULL)
+// is set for each packet that hasn't come; any of them will do.
+// returns number of packets still needed, 0 if decoded
+int sess_need(struct fecsess *s, uint64_t g, unsigned char *want)
+{
+	if (g >= s->h->ngroups)
+	{
+		if (want != NULL)
+			memset(want, 1, s->n);
+		return s->k;
+	}
+	unsigned char *have = sess_grp(s, g);
+	unsigned char *slot = have + (s->n + 7) / 8;
+	int got = 0;
+
+	for (int i = 0; i < s->n; i++)
+	{
+		int h = have[i / 8] >> (i % 8) & 1;
+		got += h;
+		if (want != NULL)
+			want[i] = !h && !slot[s->k];
+	}
+	return slot[s->k] ? 0 : s->k - got;
+}
+
+// List (up to max of) the groups below 1 + highest group seen that
+// aren't decoded yet.
+// returns how many there are in all
+long long sess_missing(struct fecsess *s, uint64_t *groups, long long max)
+{
+	long long n = 0;
+
+	for (uint64_t g = 0; g < s->h->hi; g++)
+		if (!sess_grp(s, g)[(s->n + 7) / 8 + s->k])
+		{
+			if (n < max && groups != NULL)
+				groups[n] = g;
+			n++;
+		}
+	return n;
+}
+
+// Write the data of groups 0 .. 1 + highest group seen, as d_rskm
+// would: groups not decoded yet give the data packets they have and
+// 0s for the rest.
+// returns number of groups written
+long long sess_write(struct fecsess *s, FILE *out)
+{
+	unsigned char *zero = calloc(1, s->plen);
+
+	if (zero == NULL)
+		return -1;
+	for (uint64_t g = 0; g < s->h->hi; g++)
+	{
+		unsigned char *slot = sess_grp(s, g) + (s->n + 7) / 8;
+		unsigned char *data = sess_grp(s, g) + s->meta;
+		for (int j = 0; j < s->k; j++)
+			fwrite(slot[j] == j ? data + (size_t) j * s->plen : zero, 1, s->plen, out);
+	}
+	free(zero);
+	return (long long) s->h->hi;
+}
+
+// Flush to disk and close
+// returns -1 if the data might not all be on disk
+int sess_close(struct fecsess *s)
+{
+	int ret = 0;
+
+	if (s == NULL)
+		return 0;
+	if (s->map != NULL)
+	{
+		if (msync(s->map, s->maplen, MS_SYNC) < 0)
+			ret = -1;
+		munmap(s->map, s->maplen);
+	}
+	else
+		ret = -1;
+	if (close(s->fd) < 0)
+		ret = -1;
+	free(s);
+	return ret;
+}
+
+
+
+
+/* JPEG UNEQUAL ERROR PROTECTION */
+
+/* In a JPEG, one bad byte in the headers or tables loses the image, but
+ * one bad byte of scan data only loses up to the next restart marker.
+ * So the file is split in two and each half sent as its own batchenc
+ * style stream:
+ *
+ *   stream 0: every marker segment (SOI, APPn, DQT, DHT, SOF, SOS ...,
+ *             EOI) plus a map of where the scan data goes, rskm(kh, mh)
+ *   stream 1: the entropy coded data, rskm(k, m), each restart interval
+ *             starting a packet unless it fits in what's left of one
+ *
+ * The RSTn markers themselves are kept in the map, not the scan data,
+ * so a lost scan packet can't take one with it and every interval after
+ * a loss still decodes. On the ground demux splits the streams and
+ * d_jpeg_uep puts the file back together; scan data that couldn't be
+ * recovered comes back as 0s.
+ *
+ * Map: piece count (32 bit), then per piece a kind byte (0 header,
+ * 1 interval), a 32 bit length and the RSTn byte ending it (0 for none),
+ * all little endian; then the header bytes, in order.
+ */
+
+#define JP_REC	6
+
+struct jpiece {
+	unsigned char scan;	// restart interval, else marker segment(s)
+	unsigned char mark;	// RSTn after it, or 0
+	size_t off, len;
+};
+
+struct jplist {
+	struct jpiece *p;
+	int n, cap;
+};
+
+static int jp_add(struct jplist *l, int scan, size_t off, size_t len, unsigned char mark)
+{
+	struct jpiece *last = l->n > 0 ? &l->p[l->n - 1] : NULL;
+
+	// runs of header bytes go in one piece
+	if (!scan && last != NULL && !last->scan && last->off + last->len == off)
+	{
+		last->len += len;
+		return 0;
+	}
+	if (l->n == l->cap)
+	{
+		int cap = l->cap ? 2 * l->cap : 64;
+		struct jpiece *np = realloc(l->p, cap * sizeof(struct jpiece));
+		if (np == NULL)
+			return -1;
+		l->p = np;
+		l->cap = cap;
+	}
+	l->p[l->n++] = (struct jpiece) { (unsigned char) scan, mark, off, len };
+	return 0;
+}
+
+// Split a JPEG into marker segments and restart intervals
+// returns -1 if it isn't a JPEG or out of memory
+static int jp_parse(const unsigned char *d, size_t len, struct jplist *l)
+{
+	size_t i = 2;
+	int err = 0;
+
+	if (len < 4 || d[0] != 0xff || d[1] != 0xd8)
+		return -1;
+	err |= jp_add(l, 0, 0, 2, 0);
+	while (i < len && !err)
+	{
+		if (d[i] != 0xff || i + 1 >= len || d[i+1] == 0xff)
+		{	// junk or fill bytes: keep them as they are
+			err |= jp_add(l, 0, i, 1, 0);
+			i++;
+			continue;
+		}
+		unsigned char mk = d[i+1];
+		size_t seg = 2;
+		if (!(mk == 0xd8 || mk == 0xd9 || mk == 0x01 || (mk >= 0xd0 && mk <= 0xd7)))
+			seg = i + 4 <= len ? 2 + (size_t) (d[i+2] << 8 | d[i+3]) : len - i;
+		if (i + seg > len)
+			seg = len - i;
+		err |= jp_add(l, 0, i, seg, 0);
+		i += seg;
+		if (mk != 0xda)
+			continue;
+
+		// entropy coded data up to the next marker that isn't RSTn
+		size_t s = i;
+		for (;;)
+		{
+			if (i + 1 >= len)
+			{
+				i = len;
+				err |= jp_add(l, 1, s, i - s, 0);
+				break;
+			}
+			if (d[i] == 0xff && d[i+1] != 0x00 && d[i+1] != 0xff)
+			{
+				if (d[i+1] >= 0xd0 && d[i+1] <= 0xd7)
+				{
+					err |= jp_add(l, 1, s, i - s, d[i+1]);
+					i += 2;
+					s = i;
+					continue;
+				}
+				err |= jp_add(l, 1, s, i - s, 0);
+				break;
+			}
+			i++;
+		}
+	}
+	return err ? -1 : 0;
+}
+
+// Where each interval goes in the scan stream (at[i], for scan pieces)
+// returns the stream length, a whole number of packets
+static uint64_t jp_place(const struct jpiece *p, int n, unsigned int plen, uint64_t *at)
+{
+	uint64_t pos = 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		if (!p[i].scan)
+			continue;
+		uint64_t room = plen - pos % plen;
+		if (pos % plen != 0 && p[i].len > room)
+			pos += room;
+		at[i] = pos;
+		pos += p[i].len;
+	}
+	return (pos + plen - 1) / plen * plen;
+}
+
+// Send coded packets from f as stream sid
+static long long jp_send(FILE *f, unsigned int sid, unsigned int plen, FILE *out)
+{
+	unsigned char pkt[BATCH_HDR + plen];
+	long long n, total;
+
+	fseek(f, 0, SEEK_END);
+	total = ftell(f) / plen;
+	rewind(f);
+	for (n = 0; n < total; n++)
+	{
+		if (fread(pkt + BATCH_HDR, 1, plen, f) != plen)
+			break;
+		batch_hdr(pkt, sid, (uint32_t) n, plen | (n == total - 1 ? BATCH_LAST : 0));
+		addUDP(plen + BATCH_HDR, out);
+		fwrite(pkt, 1, BATCH_HDR + plen, out);
+	}
+	return n;
+}
+
+// Encode a JPEG from in as two demux streams (see above) on out
+// returns packets written, or -1 (not a JPEG, bad parameters, no memory)
+long long jpeg_uep(const struct uepcfg *c, FILE *in, FILE *out)
+{
+	unsigned int plen = plenof(c->plen);
+	if (plen < 1 || plen >= BATCH_LAST || plen + BATCH_HDR > 65535)
+		return -1;
+
+	struct jplist l = { NULL, 0, 0 };
+	size_t len;
+	unsigned char *d = slurp(in, &len);
+	uint64_t *at = NULL;
+	FILE *raw[2] = { tmpfile(), tmpfile() };
+	FILE *coded[2] = { tmpfile(), tmpfile() };
+	long long sent = -1;
+
+	STAT_START(t0);
+	if (d == NULL || raw[0] == NULL || raw[1] == NULL || coded[0] == NULL
+		|| coded[1] == NULL || jp_parse(d, len, &l) < 0)
+		goto done;
+	at = calloc(l.n ? l.n : 1, sizeof(uint64_t));
+	if (at == NULL)
+		goto done;
+
+	// stream 0: map, then header bytes
+	unsigned char rec[JP_REC];
+	rec[0] = (unsigned char) l.n;
+	rec[1] = (unsigned char) (l.n >> 8);
+	rec[2] = (unsigned char) (l.n >> 16);
+	rec[3] = (unsigned char) (l.n >> 24);
+	fwrite(rec, 1, 4, raw[0]);
+	for (int i = 0; i < l.n; i++)
+	{
+		uint32_t n = (uint32_t) l.p[i].len;
+		rec[0] = l.p[i].scan;
+		rec[1] = (unsigned char) n;
+		rec[2] = (unsigned char) (n >> 8);
+		rec[3] = (unsigned char) (n >> 16);
+		rec[4] = (unsigned char) (n >> 24);
+		rec[5] = l.p[i].mark;
+		fwrite(rec, 1, JP_REC, raw[0]);
+	}
+	for (int i = 0; i < l.n; i++)
+		if (!l.p[i].scan)
+			fwrite(d + l.p[i].off, 1, l.p[i].len, raw[0]);
+
+	// stream 1: intervals, placed on packet boundaries
+	uint64_t slen = jp_place(l.p, l.n, plen, at), pos = 0;
+	for (int i = 0; i < l.n; i++)
+	{
+		if (!l.p[i].scan)
+			continue;
+		for (; pos < at[i]; pos++)
+			fputc(0x00, raw[1]);
+		fwrite(d + l.p[i].off, 1, l.p[i].len, raw[1]);
+		pos += l.p[i].len;
+	}
+	for (; pos < slen; pos++)
+		fputc(0x00, raw[1]);
+
+	rewind(raw[0]);
+	rewind(raw[1]);
+	if (rskm(c->kh, c->mh, plen, 0, raw[0], coded[0]) < 0
+		|| rskm(c->k, c->m, plen, 0, raw[1], coded[1]) < 0)
+		goto done;
+	sent = jp_send(coded[0], 0, plen, out);
+	sent += jp_send(coded[1], 1, plen, out);
+
+done:
+	STAT_STOP(ST_JPEG, t0, len, sent > 0 ? (unsigned long long) sent * (plen + BATCH_HDR + 8) : 0,
+		l.n);
+	for (int s = 0; s < 2; s++)
+	{
+		if (raw[s] != NULL)
+			fclose(raw[s]);
+		if (coded[s] != NULL)
+			fclose(coded[s]);
+	}
+	free(at);
+	free(l.p);
+	free(d);
+	return sent;
+}
+
+// rskm decode one demuxed stream, with its erasure map, into memory
+static unsigned char *jp_recv(FILE *f, const unsigned char *eras, uint64_t neras,
+	int k, int m, unsigned int plen, size_t *len)
+{
+	FILE *dec = tmpfile();
+	unsigned char *d = NULL;
+
+	if (dec == NULL)
+		return NULL;
+	rewind(f);
+	if (d_rskm(k, m, plen, (int) neras, eras, f, dec) >= 0)
+	{
+		rewind(dec);
+		d = slurp(dec, len);
+	}
+	fclose(dec);
+	return d;
+}
+
+// Put a JPEG sent by jpeg_uep back together
+// returns 0, or -1 if the headers and map couldn't be recovered
+int d_jpeg_uep(const struct uepcfg *c, FILE *in, FILE *out)
+{
+	unsigned int plen = plenof(c->plen);
+	if (plen < 1 || plen >= BATCH_LAST || plen + BATCH_HDR > 65535)
+		return -1;
+
+	FILE *st[2] = { tmpfile(), tmpfile() };
+	unsigned char *eras[2] = { NULL, NULL };
+	uint64_t neras[2] = { 0, 0 };
+	unsigned char *hd = NULL, *sd = NULL;
+	size_t hlen = 0, slen = 0;
+	struct jplist l = { NULL, 0, 0 };
+	uint64_t *at = NULL;
+	int ret = -1;
+
+	STAT_START(t0);
+	if (st[0] == NULL || st[1] == NULL || demuxe(plen, in, st, 2, NULL, NULL, eras, neras) < 0)
+		goto done;
+	hd = jp_recv(st[0], eras[0], neras[0], c->kh, c->mh, plen, &hlen);
+	sd = jp_recv(st[1], eras[1], neras[1], c->k, c->m, plen, &slen);
+	if (hd == NULL || sd == NULL || hlen < 4)
+		goto done;
+
+	// read back the map; anything that doesn't add up is a lost header
+	uint32_t n = hd[0] | hd[1] << 8 | hd[2] << 16 | (uint32_t) hd[3] << 24;
+	if (n == 0 || n > (hlen - 4) / JP_REC)
+		goto done;
+	size_t hpos = 4 + (size_t) n * JP_REC;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		const unsigned char *r = hd + 4 + (size_t) i * JP_REC;
+		size_t sz = r[1] | r[2] << 8 | r[3] << 16 | (size_t) r[4] << 24;
+		if (r[0] > 1 || (r[5] != 0 && (r[5] < 0xd0 || r[5] > 0xd7))
+			|| jp_add(&l, r[0], r[0] ? 0 : hpos, sz, r[5]) < 0)
+			goto done;
+		if (!r[0])
+		{
+			hpos += sz;
+			if (hpos > hlen)
+				goto done;
+		}
+	}
+	at = calloc(l.n, sizeof(uint64_t));
+	if (at == NULL)
+		goto done;
+	jp_place(l.p, l.n, plen, at);
+
+	for (int i = 0; i < l.n; i++)
+	{
+		const struct jpiece *p = &l.p[i];
+		if (!p->scan)
+			fwrite(hd + p->off, 1, p->len, out);
+		else
+		{
+			size_t have = at[i] >= slen ? 0 : slen - at[i];
+			if (have > p->len)
+				have = p->len;
+			fwrite(sd + at[i], 1, have, out);
+			for (size_t z = have; z < p->len; z++)
+				fputc(0x00, out);
+			if (p->mark)
+			{
+				fputc(0xff, out);
+				fputc(p->mark, out);
+			}
+		}
+	}
+	ret = 0;
+
+done:
+	STAT_STOP(ST_D_JPEG, t0, 0, 0, l.n);
+	for (int s = 0; s < 2; s++)
+	{
+		if (st[s] != NULL)
+			fclose(st[s]);
+		free(eras[s]);
+	}
+	free(at);
+	free(l.p);
+	free(hd);
+	free(sd);
+	return ret;
+}
+
+
+
+
+/* DIVERSITY COMBINING */
+
+/* The same pass heard at several ground stations, or the same packets
+ * sent again on a later pass, gives several copies of one inlvUDPx
+ * stream. combine() finds the frames of each copy by sync word and seq,
+ * as decUDPx does, so a copy that lost or gained frames stays lined up
+ * with the rest, and writes one inlvUDPx stream back out for decUDPx,
+ * with clean headers:
+ *
+ *  - with a CRC-32C trailer in each payload, the first copy whose CRC
+ *    checks is taken as it is;
+ *  - otherwise every copy that has the packet votes on each bit of the
+ *    payload, so a bit wrong in fewer than half the copies comes out
+ *    right.
+ *
+ * Copies are taken best first: fewest bad header bits (sync word, UDP
+ * header, seq and length that don't decode), then by copy number. The
+ * first one wins with fewer than 3 copies, and its vote counts twice to
+ * break ties with an even number.
+ *
+ * The vote counts each bit position in its own byte lane (copies ×
+ * 8 adds), then compares the counts with half, 32 bytes a step with
+ * AVX2, 16 with SSE2, 8 with plain 64 bit words.
+ */
+
+#define COMB_MAX	64	// copies
+
+// Bitwise majority of n (odd) buffers of len bytes
+static void vote(const unsigned char **cp, int n, size_t len, unsigned char *out)
+{
+	size_t i = 0;
+	int half = n / 2;
+
+#if defined(__AVX2__)
+	const __m256i one = _mm256_set1_epi8(1), thr = _mm256_set1_epi8((char) half);
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i cnt[8], r = _mm256_setzero_si256();
+		for (int k = 0; k < 8; k++)
+			cnt[k] = _mm256_setzero_si256();
+		for (int c = 0; c < n; c++)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i *) (cp[c] + i));
+			for (int k = 0; k < 8; k++)
+				cnt[k] = _mm256_add_epi8(cnt[k], _mm256_and_si256(_mm256_srli_epi16(v, k), one));
+		}
+		for (int k = 0; k < 8; k++)
+			r = _mm256_or_si256(r, _mm256_and_si256(_mm256_cmpgt_epi8(cnt[k], thr),
+				_mm256_set1_epi8((char) (1 << k))));
+		_mm256_storeu_si256((__m256i *) (out + i), r);
+	}
+#elif defined(__SSE2__)
+	const __m128i one = _mm_set1_epi8(1), thr = _mm_set1_epi8((char) half);
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i cnt[8], r = _mm_setzero_si128();
+		for (int k = 0; k < 8; k++)
+			cnt[k] = _mm_setzero_si128();
+		for (int c = 0; c < n; c++)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *) (cp[c] + i));
+			for (int k = 0; k < 8; k++)
+				cnt[k] = _mm_add_epi8(cnt[k], _mm_and_si128(_mm_srli_epi16(v, k), one));
+		}
+		for (int k = 0; k < 8; k++)
+			r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(cnt[k], thr),
+				_mm_set1_epi8((char) (1 << k))));
+		_mm_storeu_si128((__m128i *) (out + i), r);
+	}
+#else
+	// counts stay under 128, so adding 127 - half carries into bit 7 of
+	// a lane exactly when its count is over half
+	const uint64_t ones = 0x0101010101010101ull;
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64_t cnt[8] = { 0 }, r = 0;
+		for (int c = 0; c < n; c++)
+		{
+			uint64_t v;
+			memcpy(&v, cp[c] + i, 8);
+			for (int k = 0; k < 8; k++)
+				cnt[k] += (v >> k) & ones;
+		}
+		for (int k = 0; k < 8; k++)
+			r |= (((cnt[k] + (127 - half) * ones) >> 7) & ones) << k;
+		memcpy(out + i, &r, 8);
+	}
+#endif
+	for (; i < len; i++)
+	{
+		unsigned char r = 0;
+		for (int k = 0; k < 8; k++)
+		{
+			int cnt = 0;
+			for (int c = 0; c < n; c++)
+				cnt += (cp[c][i] >> k) & 1;
+			r |= (unsigned char) ((cnt > half) << k);
+		}
+		out[i] = r;
+	}
+}
+
+// Payload ends in a CRC-32C of the rest of it
+static int comb_crc(const unsigned char *p, unsigned int plen)
+{
+	unsigned int dlen = plen - 4;
+	uint32_t crc = p[dlen] | p[dlen + 1] << 8 | p[dlen + 2] << 16 | (uint32_t) p[dlen + 3] << 24;
+	return crc32c(0, p, dlen) == crc;
+}
+
+// One copy, its whole frames indexed by seq
+struct combcopy {
+	unsigned char *buf;
+	size_t size;
+	long n;			// packets indexed
+	size_t *at;		// frame of each, or SIZE_MAX
+	unsigned int *len;
+	int *dmg;
+};
+
+static int comb_index(struct combcopy *c, unsigned int plen)
+{
+	struct phscan s;
+	size_t at;
+	long seq, cap = 0;
+	unsigned int len;
+	int dmg;
+
+	ph_start(&s, c->buf, c->size, plen);
+	while (ph_scan(&s, &at, &seq, &len, &dmg))
+	{
+		if (at + s.flen > c->size)
+			break;	// a cut off frame is no frame
+		if (seq >= cap)
+		{
+			long ncap = cap ? cap : 256;
+			while (ncap <= seq)
+				ncap *= 2;
+			size_t *a = realloc(c->at, ncap * sizeof(*a));
+			if (a != NULL)
+				c->at = a;
+			unsigned int *l = realloc(c->len, ncap * sizeof(*l));
+			if (l != NULL)
+				c->len = l;
+			int *d = realloc(c->dmg, ncap * sizeof(*d));
+			if (d != NULL)
+				c->dmg = d;
+			if (a == NULL || l == NULL || d == NULL)
+				return -1;
+			cap = ncap;
+		}
+		for (; c->n < seq; c->n++)
+			c->at[c->n] = SIZE_MAX;
+		c->at[seq] = at;
+		c->len[seq] = len;
+		c->dmg[seq] = dmg;
+		c->n = seq + 1;
+	}
+	return 0;
+}
+
+// Combine ncopy raw captures (in[]) of one inlvUDPx stream of plen byte
+// packets; crc: each payload ends in a CRC-32C of the rest of it. Packets
+// no copy has are left out, for decUDPx to fill in.
+// returns number of packets written, or -1
+long long combine(int ncopy, FILE **in, unsigned int plen, int crc, FILE *out)
+{
+	plen = plenof(plen);
+	if (ncopy < 1 || ncopy > COMB_MAX || plen + PH_LEN > 65535 || plen < (crc ? 5u : 1u))
+		return -1;
+	hn_init();
+
+	struct combcopy cc[COMB_MAX];
+	unsigned char *fused = malloc(PH_LEN + plen);
+	long long pnum = 0;
+	unsigned long long bin = 0;
+	long total = 0;
+
+	memset(cc, 0, sizeof(cc));
+	if (fused == NULL)
+		return -1;
+	STAT_START(t0);
+	for (int c = 0; c < ncopy; c++)
+	{
+		cc[c].buf = slurp(in[c], &cc[c].size);
+		if (cc[c].buf == NULL || comb_index(&cc[c], plen) < 0)
+		{
+			pnum = -1;
+			goto done;
+		}
+		bin += cc[c].size;
+		if (cc[c].n > total)
+			total = cc[c].n;
+	}
+
+	for (long i = 0; i < total; i++)
+	{
+		const unsigned char *cp[COMB_MAX + 1];
+		int best[COMB_MAX];
+		int n = 0;
+
+		// best copy first
+		for (int c = 0; c < ncopy; c++)
+		{
+			if (i >= cc[c].n || cc[c].at[i] == SIZE_MAX)
+				continue;
+			int k = n++;
+			for (; k > 0 && cc[best[k - 1]].dmg[i] > cc[c].dmg[i]; k--)
+				best[k] = best[k - 1];
+			best[k] = c;
+		}
+		if (n == 0)
+			continue;
+		for (int k = 0; k < n; k++)
+			cp[k] = cc[best[k]].buf + cc[best[k]].at[i] + 8 + PH_LEN;
+
+		const unsigned char *pick = NULL;
+		for (int k = 0; crc && k < n && pick == NULL; k++)
+			if (comb_crc(cp[k], plen))
+				pick = cp[k];
+		if (pick == NULL && n < 3)
+			pick = cp[0];	// nothing to outvote it
+		if (pick == NULL)
+		{
+			if (n % 2 == 0)
+				cp[n++] = cp[0];
+			vote(cp, n, plen, fused + PH_LEN);
+			pick = fused + PH_LEN;
+		}
+
+		unsigned int len = cc[best[0]].len[i];
+		ph_frame(fused, (unsigned int) i, len);
+		addUDP(plen + PH_LEN, out);
+		fwrite(fused, 1, PH_LEN, out);
+		if (fwrite(pick, 1, plen, out) != plen)
+		{
+			pnum = -1;
+			goto done;
+		}
+		pnum++;
+		if (len < plen)
+			break;	// the last packet
+	}
+done:
+	STAT_STOP(ST_COMBINE, t0, bin, pnum > 0 ? pnum * (plen + PH_LEN + 8) : 0,
+		pnum > 0 ? pnum : 0);
+	for (int c = 0; c < ncopy; c++)
+	{
+		free(cc[c].buf);
+		free(cc[c].at);
+		free(cc[c].len);
+		free(cc[c].dmg);
+	}
+	free(fused);
+	return pnum;
+}
+
+
+
+
+/* DATA SCRAMBLING FUNCTIONS
+ * to aid in testing
+ */
+
+
+
+// Stratified scramble
+// Every n bytes, the read char will be XORed with 0xff.
+
+void sstrat(int n, FILE *in, FILE *out)
+{
+        int end = 0;
+        while (!end)
+        {
+                int c, alt;
+                for (int i = 0; i < n-1 && !end; i++)
+                {
+                        c = fgetc(in);
+                        if (c==EOF)
+                                end = 1;
+                        else
+                                fputc((unsigned char) c,out);
+                }
+                alt = fgetc(in);
+                if (alt==EOF)
+                        break;
+                else
+                {
+                        unsigned char temp = ((unsigned char) alt) ^ 0xff;
+                        fputc(temp,out);
+                }
+        }
+        return;
+}
+
+// scrambles by &&ing with a random number a power of 2 times
+// 1 in 2^n chance of any bit being flipped
+void scram(int n, FILE *in, FILE *out)
+{
+  int end = 0;
+  int next = 0;
+  srand(time(0));
+
+  while ((next=fgetc(in)) != EOF)
+  {
+    unsigned char c = (unsigned char) next;
+    unsigned char flip = 0xff;
     for (int i = 0; i < n; i++)
     {
       flip &= (unsigned char) rand();
@@ -816,3 +6477,119 @@ void scram(int n, FILE *in, FILE *out)
     fputc(c,out);
   }
 }
+
+
+
+/* BIT ERROR COUNTING
+ * to check what the decoders give back against the original
+ */
+
+// Equal stretches are skipped a vector at a time (AVX2, SSE2, or 64 bit
+// words); only vectors with a difference in them are looked at byte by
+// byte, so a nearly right file goes at memory speed.
+
+struct bcstate {
+	struct bitcmpres *r;
+	unsigned int plen;
+	uint32_t *pkt;
+	struct bitdiff *first;
+	long nfirst;
+	uint64_t runstart, runend;	// current run of bad bytes
+};
+
+static void bc_endrun(struct bcstate *s)
+{
+	uint64_t n = s->runend - s->runstart;
+	if (n == 0)
+		return;
+	int b = 63 - __builtin_clzll(n);
+	s->r->runhist[b < BITCMP_HIST ? b : BITCMP_HIST - 1]++;
+	s->r->runs++;
+	if (n > s->r->longest)
+		s->r->longest = n;
+}
+
+static void bc_bytes(struct bcstate *s, const unsigned char *a, const unsigned char *b,
+	uint64_t off, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		unsigned char x = a[i] ^ b[i];
+		if (x == 0)
+			continue;
+		uint64_t at = off + i;
+		int bits = __builtin_popcount(x);
+		s->r->bits += bits;
+		s->r->bytes++;
+		if (s->pkt != NULL)
+			s->pkt[at / s->plen] += bits;
+		if (s->r->ndiff < s->nfirst)
+			s->first[s->r->ndiff++] = (struct bitdiff) { at, a[i], b[i] };
+		if (at != s->runend)
+		{
+			bc_endrun(s);
+			s->runstart = at;
+		}
+		s->runend = at + 1;
+	}
+}
+
+// Compare len bytes of a and b. With plen > 0, pkt (if not NULL, one
+// entry per packet, zeroed first) gets the bad bits in each packet.
+// first gets the first nfirst differences.
+// returns 0
+int bitcmp(const unsigned char *a, const unsigned char *b, uint64_t len,
+	unsigned int plen, uint32_t *pkt, struct bitdiff *first, long nfirst,
+	struct bitcmpres *r)
+{
+	struct bcstate s = { r, plen, plen ? pkt : NULL, first, first ? nfirst : 0, 0, 0 };
+	uint64_t off = 0;
+
+	memset(r, 0, sizeof(*r));
+	r->len = len;
+	if (s.pkt != NULL)
+		memset(s.pkt, 0, (len + plen - 1) / plen * sizeof(uint32_t));
+
+#if defined(__AVX2__)
+	for (; off + 128 <= len; off += 128)
+	{
+		__m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (a + off)),
+			_mm256_loadu_si256((const __m256i *) (b + off)));
+		__m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (a + off + 32)),
+			_mm256_loadu_si256((const __m256i *) (b + off + 32)));
+		__m256i x2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (a + off + 64)),
+			_mm256_loadu_si256((const __m256i *) (b + off + 64)));
+		__m256i x3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (a + off + 96)),
+			_mm256_loadu_si256((const __m256i *) (b + off + 96)));
+		__m256i x = _mm256_or_si256(_mm256_or_si256(x0, x1), _mm256_or_si256(x2, x3));
+		if (!_mm256_testz_si256(x, x))
+			bc_bytes(&s, a + off, b + off, off, 128);
+	}
+#elif defined(__SSE2__)
+	for (; off + 64 <= len; off += 64)
+	{
+		__m128i x = _mm_setzero_si128();
+		for (int i = 0; i < 64; i += 16)
+			x = _mm_or_si128(x, _mm_xor_si128(_mm_loadu_si128((const __m128i *) (a + off + i)),
+				_mm_loadu_si128((const __m128i *) (b + off + i))));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xffff)
+			bc_bytes(&s, a + off, b + off, off, 64);
+	}
+#else
+	for (; off + 32 <= len; off += 32)
+	{
+		uint64_t wa[4], wb[4];
+		memcpy(wa, a + off, 32);
+		memcpy(wb, b + off, 32);
+		if ((wa[0] ^ wb[0]) | (wa[1] ^ wb[1]) | (wa[2] ^ wb[2]) | (wa[3] ^ wb[3]))
+			bc_bytes(&s, a + off, b + off, off, 32);
+	}
+#endif
+	bc_bytes(&s, a + off, b + off, off, len - off);
+	bc_endrun(&s);
+
+	if (s.pkt != NULL)
+		for (uint64_t p = 0; p < (len + plen - 1) / plen; p++)
+			r->packets += s.pkt[p] != 0;
+	return 0;
+}
@@ -1,21 +1,75 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdio.h>
+#include <stdint.h>
+
 // Adds UDP packet: broadcast, no checksum, dest port 0
 int addUDP(unsigned int length, FILE *out);
 
 // Add UDP packet headers to a stream of data
 int inlvUDP(unsigned int length, FILE *in, FILE *out);
 
-// "Decode" UDP stream. See fec.c
+// "Decode" UDP stream. See fec.c. Returns number of packets dropped.
 int decUDP(int pnum, unsigned int plen, FILE *in, FILE *out);
 
+// CRC-32C; crc = 0 to start, or the previous result to continue
+uint32_t crc32c(uint32_t crc, const unsigned char *buf, size_t len);
+
+// inlvUDP with a CRC-32C in the last 4 bytes of each packet
+int inlvUDPcrc(unsigned int length, FILE *in, FILE *out);
+
+// decode inlvUDPcrc; eras gets 1 for every packet dropped or failing the CRC
+int decUDPcrc(int pnum, unsigned int plen, unsigned char *eras, FILE *in, FILE *out);
+
 // Encode hamming 7,4
 int h74(FILE *in, FILE *out);
 
 // decode h 7,4
 int d_h74(FILE *in, FILE *out);
 
+// Encode hamming 7,4 one nibble per codeword byte (secded: extended 8,4)
+int h74n(int secded, FILE *in, FILE *out);
+
+// decode h74n. returns codewords with two bad bits (secded only)
+int d_h74n(int secded, FILE *in, FILE *out);
+
+// h74n on buffers: len bytes in, 2*len out
+void h74nblk_enc(int secded, const unsigned char *in, size_t len, unsigned char *out);
+
+// len codeword bytes in, len/2 out
+int h74nblk_dec(int secded, const unsigned char *in, size_t len, unsigned char *out);
+
+// UDP with a protected header (sync word, Hamming coded seq and length)
+int inlvUDPx(unsigned int plen, FILE *in, FILE *out);
+
+// Raw capture receiver for inlvUDPx; returns packets written
+long decUDPx(unsigned int plen, unsigned char *eras, long maxp, FILE *in, FILE *out);
+
+// CCSDS randomizer, packet by packet; its own inverse
+void rndblk(unsigned char *buf, size_t len);
+int rnd(unsigned int plen, FILE *in, FILE *out);
+int d_rnd(unsigned int plen, FILE *in, FILE *out);
+
+// h74 on buffers: 7 bytes out per 4 in; returns bytes written
+size_t h74blk_enc(const unsigned char *in, size_t len, unsigned char *out);
+
+// d_h74 on buffers: 4 bytes out per 7 in; returns bytes written
+size_t h74blk_dec(const unsigned char *in, size_t len, unsigned char *out);
+
 // Break up stream into hamming code interleaved packets
 int inlvham(unsigned int plen, FILE *in, FILE *out);
 
+// Bit interleave within each packet (run after h74/inlvham, before inlvUDP)
+int bilv(unsigned int depth, unsigned int plen, FILE *in, FILE *out);
+
+// undo bilv
+int d_bilv(unsigned int depth, unsigned int plen, FILE *in, FILE *out);
+
+// bilv on one packet
+void bilvblk(unsigned int depth, const unsigned char *in, size_t len, unsigned char *out);
+void d_bilvblk(unsigned int depth, const unsigned char *in, size_t len, unsigned char *out);
+
 // Stratified scrambler
 void sstrat(int n, FILE *in, FILE *out);
 
@@ -36,3 +90,328 @@ int mulGF(unsigned char poly1, unsigned char poly2,
 	unsigned short power, unsigned short generator);
 
 */
+
+
+// decode rs2x1 with packet erasure flags (NULL: all-0 packets are erased)
+int d_rs2x1e(unsigned int plen, int pnum, const unsigned char *eras, FILE *in, FILE *out);
+
+// Reed-Solomon (k,m) erasure code across packets: k data packets, m parity
+int rskm(int k, int m, unsigned int plen, int groups, FILE *in, FILE *out);
+
+// decode rskm. eras flags erased packets (NULL: all-0 packets are erased)
+int d_rskm(int k, int m, unsigned int plen, int pnum,
+	const unsigned char *eras, FILE *in, FILE *out);
+
+// Reed-Solomon with nroots parity symbols (fixes 2*errors + erasures <= nroots)
+// on a block of depth interleaved codewords of n symbols:
+// symbol i of codeword c is blk[i*depth + c]. Data goes in the first
+// n - nroots rows, parity in the rest.
+void rsblk_enc(int nroots, int n, int depth, unsigned char *blk);
+
+// eras: NULL or one flag per byte of blk (nonzero = known bad)
+// res: NULL or depth entries, set to symbols fixed per codeword (-1 = failed)
+// returns number of codewords that could not be corrected
+int rsblk_dec(int nroots, int n, int depth, unsigned char *blk,
+	const unsigned char *eras, int *res);
+
+// RS(255,223) stream, depth interleaved codewords per block
+int rs255(int depth, FILE *in, FILE *out);
+
+// decode rs255. returns number of codewords that could not be corrected
+int d_rs255(int depth, FILE *in, FILE *out);
+
+// Product code: inner code along each packet, RS(k+m, k) down the columns
+#define PROD_HAM 1	// inner Hamming (7,4), h74 layout
+#define PROD_RS  2	// inner RS with nr parity symbols
+
+int prod(int k, int m, int inner, int nr, unsigned int plen, FILE *in, FILE *out);
+
+// iterative decode using nthreads threads; eras as for d_rskm
+// returns number of data bytes left erased
+int d_prod(int k, int m, int inner, int nr, unsigned int plen, int pnum,
+	const unsigned char *eras, int iters, int nthreads, FILE *in, FILE *out);
+
+// Emergency mode: send every packet r times
+int rep(int r, unsigned int plen, FILE *in, FILE *out);
+
+// decode rep: keeps first copy of each packet that was not dropped
+int d_rep(int r, unsigned int plen, int pnum, FILE *in, FILE *out);
+
+// Convolutional code, K=7 (CCSDS), for the emergency link
+#define CONV_12 0	// rate 1/2
+#define CONV_23 1	// punctured to 2/3
+#define CONV_34 2	// punctured to 3/4
+#define CONV_FRAME 256	// data bytes per terminated frame
+
+int conv(int rate, FILE *in, FILE *out);
+
+// Viterbi decode; soft = 0: packed bits as from conv, 1: a byte per symbol
+int d_conv(int rate, int soft, FILE *in, FILE *out);
+
+// symbols per frame on the link
+int conv_nsym(int rate);
+
+// one frame: CONV_FRAME bytes in, packed symbols out (returns bytes)
+int convblk_enc(int rate, const unsigned char *in, unsigned char *out);
+
+// one frame: conv_nsym soft symbols in, CONV_FRAME bytes out
+void convblk_dec(int rate, const unsigned char *sym, unsigned char *out);
+
+
+// Pass planning
+
+#define PLAN_HAM 1	// h74 + inlvham
+#define PLAN_RS  2	// rskm(k, m)
+#define PLAN_REP 3	// rep(k)
+
+struct passplan {
+	int codec;		// PLAN_*
+	int k, m;		// rskm parameters; for PLAN_REP, k is r
+	unsigned int plen;
+	double rate;		// data bytes per byte on air (headers included)
+	double goodput;		// expected fraction of data bytes delivered intact
+	double delivered;	// expected data bytes delivered this pass
+};
+
+// Pick the codec that delivers the most of the queue in one pass
+int planpass(double secs, double bps, double ber, double loss,
+	unsigned long queue, unsigned int plen, struct passplan *plan);
+
+// Adjusts rskm m between blocks from the drop rate seen by decUDP
+struct mctrl {
+	int k, m;
+	int mmin, mmax;
+	double loss;		// smoothed packet drop rate
+	double target;		// acceptable chance of losing a group
+};
+
+void mctrl_init(struct mctrl *c, int k, int mmin, int mmax, double target);
+
+// feed in decUDP's result for the last block; returns m for the next one
+int mctrl_update(struct mctrl *c, int dropped, int total);
+
+// Packet length: plen (length) 0 in the packet functions means this
+void setplen(unsigned int plen);
+unsigned int getplen(void);
+
+// Channel for tuneplen
+struct fecchan {
+	double ber;		// average bit error rate
+	double burst;		// mean error burst length in bits (<= 1: none)
+	double loss;		// packet loss on top of bit errors
+};
+
+struct plentune {
+	unsigned int plen;	// for inlvUDPcrc (CRC included)
+	int k, m;		// rskm parameters to go with it
+	double eff;		// data bytes out per byte on air, model
+	double resid;		// fraction of data lost after decoding, model
+	double sim, simresid;	// the same, simulated
+};
+
+// Best plen in [pmin, pmax] with rskm k <= kmax over channel ch,
+// losing at most target of the data
+int tuneplen(const struct fecchan *ch, double target, unsigned int pmin,
+	unsigned int pmax, int kmax, struct plentune *best);
+
+
+// Pipeline: reader thread -> codec threads -> writer thread
+
+// One block codec: len bytes in, returns bytes written to out
+typedef size_t (*fecblkfn)(void *arg, const unsigned char *in, size_t len,
+	unsigned char *out);
+
+struct fecstage {
+	fecblkfn fn;
+	void *arg;
+	size_t inlen;	// bytes per call (only the last call gets fewer)
+	size_t outlen;	// room one call needs in out
+};
+
+// How full one ring is, and who has been waiting on it
+struct fecocc {
+	unsigned int fill;		// slots in use now
+	unsigned int nslots;
+	unsigned int hiwater;		// most slots ever in use
+	unsigned long slots;		// slots passed through
+	unsigned long fullwait;		// producer waits (consumer too slow)
+	unsigned long emptywait;	// consumer waits (producer too slow)
+};
+
+struct fecpipe;
+
+// Each stage gets the whole output of the one before, so fecpipe_new
+// wants stages[s].inlen >= stages[s-1].outlen
+struct fecpipe *fecpipe_new(const struct fecstage *stages, int nstages,
+	int nworkers, unsigned int nslots);
+long long fecpipe_run(struct fecpipe *p, FILE *in, FILE *out);
+int fecpipe_occ(struct fecpipe *p, struct fecocc *occ, int max);
+void fecpipe_free(struct fecpipe *p);
+
+// Ready-made stages; arg is the depth (rs255, bilv), secded (h74n)
+// or plen (rnd, d_rnd, ilvham, udp; 0 for the auto length).
+// d_rs255 corrects in place, so its outlen is 255*depth, not 223*depth.
+// ilvham, udp and d_udp take whole groups/packets: 7*plen, plen (out
+// plen+8 each), plen+8 (out plen each).
+size_t fecblk_h74(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_d_h74(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_h74n(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_d_h74n(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_rs255(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_d_rs255(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_rnd(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_d_rnd(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_bilv(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_d_bilv(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_ilvham(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_d_ilvham(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_udp(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+size_t fecblk_d_udp(void *arg, const unsigned char *in, size_t len, unsigned char *out);
+
+// Streams: the same stages fed in pieces of any size (no threads).
+// Output lags input by at most one slot per stage.
+struct fecstream;
+
+struct fecstream *fecstream_new(const struct fecstage *stages, int nstages);
+int fecstream_push(struct fecstream *s, const void *in, size_t len);
+size_t fecstream_pull(struct fecstream *s, void *out, size_t max);
+size_t fecstream_ready(const struct fecstream *s);
+int fecstream_flush(struct fecstream *s);
+void fecstream_free(struct fecstream *s);
+
+
+// Mapped files, 64 bit sizes
+// fecmap runs one stage over a whole file; returns bytes written or -1
+long long fecmap(const struct fecstage *st, const char *inpath, const char *outpath);
+// inlvUDP / decUDP on files; return number of packets or -1
+long long fecmap_udp(unsigned int length, const char *inpath, const char *outpath);
+long long fecmap_d_udp(unsigned int plen, const char *inpath, const char *outpath,
+	uint64_t *dropped);
+
+
+// Batch encoder: several files, one packet stream, by priority
+struct fecjob {
+	const char *path;
+	int prio;		// higher goes first
+	unsigned int sid;	// stream ID, 0 - 65535
+	struct fecstage st;	// codec (st.fn == NULL: send as is)
+	long long packets;	// out: packets sent
+	int err;		// out: -1 if the file couldn't be read
+};
+
+long long batchenc(struct fecjob *jobs, int njobs, unsigned int plen,
+	int nthreads, FILE *out);
+long long demux(unsigned int plen, FILE *in, FILE **outs, int nouts, uint64_t *lost,
+	unsigned char *ended);
+
+// demux, plus a malloc'd erasure map per stream (1 = lost) for d_rskm
+long long demuxe(unsigned int plen, FILE *in, FILE **outs, int nouts, uint64_t *lost,
+	unsigned char *ended, unsigned char **eras, uint64_t *neras);
+
+
+// JPEG unequal error protection: headers and tables strongly coded,
+// scan data at the normal rate, restart intervals aligned to packets
+struct uepcfg {
+	unsigned int plen;	// 0: getplen()
+	int k, m;		// rskm for the scan data
+	int kh, mh;		// rskm for headers and tables
+};
+
+long long jpeg_uep(const struct uepcfg *c, FILE *in, FILE *out);
+int d_jpeg_uep(const struct uepcfg *c, FILE *in, FILE *out);
+
+// Decoder session: rskm packets kept on disk across passes
+struct fecsess;
+
+struct fecsess *sess_open(const char *path, int k, int m, unsigned int plen);
+int sess_add(struct fecsess *s, uint64_t pidx, const unsigned char *pkt);
+long long sess_addstream(struct fecsess *s, uint64_t first, uint64_t pnum,
+	const unsigned char *eras, FILE *in);
+int sess_need(struct fecsess *s, uint64_t g, unsigned char *want);
+long long sess_missing(struct fecsess *s, uint64_t *groups, long long max);
+long long sess_write(struct fecsess *s, FILE *out);
+int sess_close(struct fecsess *s);
+
+// Several raw captures of one inlvUDPx stream (up to 64) into one, lined
+// up by seq, by CRC or bitwise majority vote, for decUDPx
+long long combine(int ncopy, FILE **in, unsigned int plen, int crc, FILE *out);
+
+
+// Bit error counting, for checking decoder output
+
+#define BITCMP_HIST 32
+
+struct bitdiff {
+	uint64_t off;		// byte offset
+	unsigned char a, b;	// the two bytes
+};
+
+struct bitcmpres {
+	uint64_t len;		// bytes compared
+	uint64_t bits;		// bits that differ
+	uint64_t bytes;		// bytes that differ
+	uint64_t packets;	// packets with a difference (plen > 0, pkt given)
+	uint64_t runs;		// runs of consecutive differing bytes
+	uint64_t longest;	// longest run, bytes
+	uint64_t runhist[BITCMP_HIST];	// runs of 2^i to 2^(i+1)-1 bytes
+	long ndiff;		// entries filled in first
+};
+
+int bitcmp(const unsigned char *a, const unsigned char *b, uint64_t len,
+	unsigned int plen, uint32_t *pkt, struct bitdiff *first, long nfirst,
+	struct bitcmpres *r);
+
+// Statistics
+
+/* Counters kept by every stage. They are only compiled in with -DFEC_STATS;
+ * without it the functions below still exist but the counters stay 0.
+ * Each thread counts into its own fecstats, zeroed when the thread
+ * starts, or into one it hands to fecstats_use. Threads the library
+ * starts (fecpipe, batchenc, d_prod) add theirs into the caller's.
+ */
+
+enum {
+	ST_INLVUDP, ST_DECUDP,
+	ST_H74, ST_D_H74,
+	ST_INLVHAM, ST_D_INLVHAM,
+	ST_RS2X1, ST_D_RS2X1,
+	ST_RSKM, ST_D_RSKM,
+	ST_REP, ST_D_REP,
+	ST_RS255, ST_D_RS255,
+	ST_PROD, ST_D_PROD,
+	ST_H74N, ST_D_H74N,
+	ST_CONV, ST_D_CONV,
+	ST_BILV, ST_D_BILV,
+	ST_PIPE, ST_MAP, ST_BATCH, ST_SESS, ST_RND,
+	ST_UDPX, ST_D_UDPX, ST_JPEG, ST_D_JPEG, ST_STREAM, ST_COMBINE,
+	ST_COUNT
+};
+
+struct fecstats {
+	unsigned long long in[ST_COUNT];	// bytes read
+	unsigned long long out[ST_COUNT];	// bytes written
+	unsigned long long words[ST_COUNT];	// codewords/packets processed
+	unsigned long long ns[ST_COUNT];	// time spent in each stage
+	unsigned long long h74fix[7];	// bits flipped by d_h74, by syndrome position
+	unsigned long long h74nfix[8];	// bits flipped by d_h74n, by bit position
+	unsigned long long h74nbad;	// codewords d_h74n found two bad bits in
+	unsigned long long drop_port;	// packets decUDP dropped for bad dest port
+	unsigned long long drop_len;	// ... for bad length
+	unsigned long long drop_csum;	// ... for bad checksum
+	unsigned long long drop_crc;	// ... for a bad CRC-32C trailer
+	unsigned long long salvaged;	// packets decUDPx kept that decUDP would drop
+	unsigned long long rsfix;	// packets recovered by the RS decoders
+	unsigned long long rssym;	// symbols corrected by rsblk_dec
+	unsigned long long rsfail;	// codewords rsblk_dec could not correct
+};
+
+// Count into s from this thread on (NULL = back to the thread's own)
+void fecstats_use(struct fecstats *s);
+
+// Copy out the counters of this thread's fecstats
+void fecstats_snap(struct fecstats *dst);
+
+// Zero the counters of this thread's fecstats
+void fecstats_reset(void);
+
+#endif
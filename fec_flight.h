@@ -0,0 +1,51 @@
+#ifndef FEC_FLIGHT_H
+#define FEC_FLIGHT_H
+
+#include <stddef.h>
+
+/* Flight build of the encoders: no heap, no stdio, no VLAs.
+ * Every function works between buffers the caller provides, and uses a
+ * few words of stack. The GF tables are const, so they stay in flash.
+ * Output is byte for byte what the fec.c stream versions write.
+ */
+
+// Largest packet the flight build takes; size buffers with the macros
+#ifndef FL_MAXPLEN
+#define FL_MAXPLEN	1024
+#endif
+// Largest k + m for fl_rskm
+#ifndef FL_MAXKM
+#define FL_MAXKM	32
+#endif
+
+#define FL_FRAMELEN	(FL_MAXPLEN + 8)	// one UDP frame
+#define FL_GROUPLEN	(7 * FL_MAXPLEN)	// one inlvham group
+
+// h74 on a buffer: 7 bytes out per 4 in (last word padded with 0s)
+// returns bytes written
+size_t fl_h74(const unsigned char *in, size_t len, unsigned char *out);
+
+// inlvham on one group: in is 7*plen bytes of h74 output, out is 7
+// packets of plen
+// returns 7, or -1 if plen is too big
+int fl_inlvham(unsigned int plen, const unsigned char *in, unsigned char *out);
+
+// h74 then inlvham in one go, without the 7*plen in between:
+// 4*plen bytes of data in, 7 packets of plen out
+// returns 7, or -1 if plen is too big
+int fl_h74inlv(unsigned int plen, const unsigned char *in, unsigned char *out);
+
+// CCSDS randomizer on one packet in place, as rndblk; its own inverse
+void fl_rnd(unsigned char *buf, size_t len);
+
+// One UDP frame: header, len bytes of payload, 0s up to plen
+// returns plen + 8, or -1
+int fl_udp(unsigned int plen, const unsigned char *in, unsigned int len,
+	unsigned char *frame);
+
+// rskm parity for one group: data is k packets of plen, par gets m
+// returns m, or -1
+int fl_rskm(int k, int m, unsigned int plen, const unsigned char *data,
+	unsigned char *par);
+
+#endif
@@ -0,0 +1,43 @@
+#include "fec.c"
+
+// batchtest a b stream scrambled outa outb
+// a is sent as is, b with rs255; the stream gets bit errors, then demux
+// splits it and b is decoded. A bad stream header must cost one packet,
+// not the rest of the file.
+int main(int argc, char *argv[])
+{
+	struct fecjob jobs[2] = {
+		{ argv[1], 1, 0, { NULL, NULL, 0, 0 }, 0, 0 },
+		{ argv[2], 2, 1, { fecblk_rs255, (void *) 4, 223 * 4, 255 * 4 }, 0, 0 },
+	};
+
+	FILE *out = fopen(argv[3],"wb");
+	long long pnum = batchenc(jobs, 2, 1000, 2, out);
+	fclose(out);
+	printf("pnum: %lld (a %lld, b %lld)\n", pnum, jobs[0].packets, jobs[1].packets);
+
+	FILE *in = fopen(argv[3],"rb");
+	out = fopen(argv[4],"wb");
+	scram(14,in,out);
+	fclose(in);
+	fclose(out);
+
+	FILE *outs[2];
+	uint64_t lost[2];
+	unsigned char ended[2];
+	in = fopen(argv[4],"rb");
+	outs[0] = fopen(argv[5],"wb");
+	outs[1] = tmpfile();
+	demux(1000, in, outs, 2, lost, ended);
+	fclose(in);
+	fclose(outs[0]);
+	printf("a: %llu lost, %s\n", (unsigned long long) lost[0], ended[0] ? "ended" : "cut short");
+	printf("b: %llu lost, %s\n", (unsigned long long) lost[1], ended[1] ? "ended" : "cut short");
+
+	rewind(outs[1]);
+	out = fopen(argv[6],"wb");
+	d_rs255(4,outs[1],out);
+	fclose(outs[1]);
+	fclose(out);
+	return 0;
+}
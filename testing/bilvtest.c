@@ -0,0 +1,94 @@
+#include "fec.c"
+
+// bilvtest in coded damaged out
+// bilv then d_bilv must give the input back at every depth (packets that
+// aren't a whole number of blocks included). Then h74, bilv, a burst of
+// 7 bad bytes in every packet, d_bilv and d_h74: with depth >= 7 the
+// burst is spread into single bad bits that h74 fixes; depth 0 is no
+// interleaving, for comparison.
+
+#define PLEN	1120	// whole h74 codeword groups and bilv blocks
+
+static long wrong(const char *a, const char *b)
+{
+	FILE *fa = fopen(a,"rb"), *fb = fopen(b,"rb");
+	long bad = 0;
+	int x;
+	while ((x = fgetc(fa)) != EOF)
+		bad += x != fgetc(fb);
+	fclose(fa);
+	fclose(fb);
+	return bad;
+}
+
+int main(int argc, char *argv[])
+{
+	const unsigned int depths[] = { 0, 1, 4, 7, 8, 16, 35 };
+	unsigned char pkt[PLEN];
+
+	for (int d = 1; d < 7; d++)
+	{
+		FILE *in = fopen(argv[1],"rb");
+		FILE *out = fopen(argv[2],"wb");
+		bilv(depths[d],1000,in,out);
+		fclose(in);
+		fclose(out);
+		in = fopen(argv[2],"rb");
+		out = fopen(argv[4],"wb");
+		d_bilv(depths[d],1000,in,out);
+		fclose(in);
+		fclose(out);
+		printf("depth %2u: round trip %ld wrong\n", depths[d], wrong(argv[1], argv[4]));
+	}
+
+	FILE *in = fopen(argv[1],"rb");
+	FILE *out = fopen(argv[2],"wb");
+	h74(in,out);
+	fclose(in);
+	fclose(out);
+
+	for (int d = 0; d < 7; d++)
+	{
+		unsigned int depth = depths[d];
+		FILE *coded = fopen(argv[2],"rb");
+		FILE *t = tmpfile();
+		size_t got;
+		if (depth)
+			bilv(depth,PLEN,coded,t);
+		else
+			while ((got = fread(pkt, 1, PLEN, coded)) > 0)
+			{	// padded, as bilv does
+				memset(pkt + got, 0, PLEN - got);
+				fwrite(pkt, 1, PLEN, t);
+			}
+		fclose(coded);
+
+		// the burst
+		rewind(t);
+		out = fopen(argv[3],"wb");
+		while (fread(pkt, 1, PLEN, t) == PLEN)
+		{
+			for (int b = 3; b < 10; b++)
+				pkt[b] ^= 0xff;
+			fwrite(pkt, 1, PLEN, out);
+		}
+		fclose(t);
+		fclose(out);
+
+		in = fopen(argv[3],"rb");
+		t = tmpfile();
+		if (depth)
+			d_bilv(depth,PLEN,in,t);
+		else
+			while (fread(pkt, 1, PLEN, in) == PLEN)
+				fwrite(pkt, 1, PLEN, t);
+		fclose(in);
+		rewind(t);
+		out = fopen(argv[4],"wb");
+		d_h74(t,out);
+		fclose(t);
+		fclose(out);
+		printf("depth %2u: 7 byte burst per packet, %ld wrong\n", depth, wrong(argv[1], argv[4]));
+	}
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include "fec.c"
+
+/* Bit error report for two files of any size:
+ *   bitcmp original received [plen [n]]
+ * bit, byte and per packet error counts, a histogram of error run
+ * lengths, and the first n differences (default 20).
+ *
+ * gcc -O2 -march=native -I. -pthread testing/bitcmp.c -o bitcmp
+ * (-march=native for AVX2)
+ */
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s original received [plen [n]]\n", argv[0]);
+		return 2;
+	}
+	unsigned int plen = argc > 3 ? (unsigned int) atoi(argv[3]) : 0;
+	long n = argc > 4 ? atol(argv[4]) : 20;
+
+	unsigned char *a, *b;
+	uint64_t alen, blen;
+	int fa = map_in(argv[1], &a, &alen);
+	int fb = map_in(argv[2], &b, &blen);
+	if (fa < 0 || fb < 0)
+	{
+		fprintf(stderr, "can't read %s\n", fa < 0 ? argv[1] : argv[2]);
+		return 2;
+	}
+	uint64_t len = alen < blen ? alen : blen;
+
+	uint64_t np = plen ? (len + plen - 1) / plen : 0;
+	uint32_t *pkt = np ? malloc(np * sizeof(uint32_t)) : NULL;
+	struct bitdiff *first = n > 0 ? malloc(n * sizeof(struct bitdiff)) : NULL;
+	struct bitcmpres r;
+
+	double t = now();
+	bitcmp(a, b, len, plen, pkt, first, n, &r);
+	t = now() - t;
+
+	printf("compared   %llu bytes (%.2f GB/s)\n", (unsigned long long) len,
+		t > 0 ? len / t / 1e9 : 0.0);
+	if (alen != blen)
+		printf("length     %s is %llu bytes longer\n", alen > blen ? argv[1] : argv[2],
+			(unsigned long long) (alen > blen ? alen - blen : blen - alen));
+	printf("bits       %llu (BER %.3g)\n", (unsigned long long) r.bits,
+		len ? (double) r.bits / (8.0 * len) : 0.0);
+	printf("bytes      %llu\n", (unsigned long long) r.bytes);
+	printf("runs       %llu, longest %llu bytes\n", (unsigned long long) r.runs,
+		(unsigned long long) r.longest);
+
+	if (pkt != NULL)
+	{
+		printf("packets    %llu of %llu bad\n", (unsigned long long) r.packets,
+			(unsigned long long) np);
+		long shown = 0;
+		for (uint64_t p = 0; p < np && shown < n; p++)
+			if (pkt[p])
+			{
+				printf("  packet %llu: %u bits\n", (unsigned long long) p, pkt[p]);
+				shown++;
+			}
+	}
+
+	if (r.runs)
+	{
+		printf("run length (bytes)\n");
+		for (int i = 0; i < BITCMP_HIST; i++)
+			if (r.runhist[i])
+				printf("  %8llu - %-8llu %llu\n", 1ull << i, (2ull << i) - 1,
+					(unsigned long long) r.runhist[i]);
+	}
+
+	if (r.ndiff)
+	{
+		printf("first differences (offset: original received xor)\n");
+		for (long i = 0; i < r.ndiff; i++)
+			printf("  %llu: %02x %02x %02x\n", (unsigned long long) first[i].off,
+				first[i].a, first[i].b, first[i].a ^ first[i].b);
+	}
+
+	free(pkt);
+	free(first);
+	return r.bits != 0 || alen != blen;
+}
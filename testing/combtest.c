@@ -0,0 +1,109 @@
+#include "fec.c"
+
+// combtest in udpx out [ncopy [crc]]
+// in goes out as inlvUDPx in ncopy copies (default 5), each with its own
+// bit errors; copy c loses packet 3 + c, copy 1 picks up stray bytes
+// before packet 10. combine and decUDPx should give in back, lined up.
+// crc: each 500 byte payload is 496 bytes of in and a CRC-32C.
+
+// Like scram, seeded per copy (scram seeds from the clock, so copies
+// made in the same second would get the same errors)
+static void flip(int n, unsigned int seed, FILE *in, FILE *out)
+{
+	int next;
+	srand(seed);
+	while ((next = fgetc(in)) != EOF)
+	{
+		unsigned char f = 0xff;
+		for (int i = 0; i < n; i++)
+			f &= (unsigned char) rand();
+		fputc(next ^ f, out);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int ncopy = argc > 4 ? atoi(argv[4]) : 5;
+	int crc = argc > 5 && strcmp(argv[5], "crc") == 0;
+	unsigned int plen = 500, flen = plen + PH_LEN + 8;
+	unsigned int dlen = crc ? plen - 4 : plen;
+	unsigned char f[flen];
+	size_t got;
+
+	if (ncopy < 1 || ncopy > COMB_MAX)
+		return 1;
+
+	FILE *in = fopen(argv[1],"rb");
+	FILE *data = tmpfile();
+	while ((got = fread(f, 1, dlen, in)) > 0)
+	{
+		memset(f + got, 0, dlen - got);
+		fwrite(f, 1, dlen, data);
+		if (crc)
+		{
+			uint32_t c = crc32c(0, f, dlen);
+			unsigned char t[4] = { c, c >> 8, c >> 16, c >> 24 };
+			fwrite(t, 1, 4, data);
+		}
+	}
+	rewind(data);
+	FILE *out = fopen(argv[2],"wb");
+	printf("pnum: %d\n", inlvUDPx(plen, data, out));
+	fclose(out);
+
+	FILE *copies[COMB_MAX];
+	for (int c = 0; c < ncopy; c++)
+	{
+		FILE *t = tmpfile();
+		in = fopen(argv[2],"rb");
+		for (int i = 0; (got = fread(f, 1, flen, in)) > 0; i++)
+		{
+			if (i == 3 + c)
+				continue;
+			if (i == 10 && c == 1)
+				fwrite("\x1a\xcf\xfc\x1d\x00\x00\x00", 1, 7, t);
+			fwrite(f, 1, got, t);
+		}
+		fclose(in);
+		rewind(t);
+		copies[c] = tmpfile();
+		flip(10, c + 1, t, copies[c]);
+		fclose(t);
+		rewind(copies[c]);
+	}
+
+	FILE *comb = tmpfile();
+	printf("combined: %lld\n", combine(ncopy, copies, plen, crc, comb));
+	for (int c = 0; c < ncopy; c++)
+		fclose(copies[c]);
+	rewind(comb);
+	FILE *dec = tmpfile();
+	printf("decoded: %ld\n", decUDPx(plen, NULL, 0, comb, dec));
+	fclose(comb);
+
+	// payloads back, CRCs off
+	rewind(dec);
+	out = fopen(argv[3],"wb");
+	while (fread(f, 1, plen, dec) == plen)
+		fwrite(f, 1, dlen, out);
+	fclose(dec);
+	fclose(out);
+
+	// wrong bytes, against in padded out to whole packets
+	long bad = 0, n = 0;
+	int a, b;
+	rewind(data);
+	in = fopen(argv[3],"rb");
+	for (long i = 0; (a = fgetc(data)) != EOF; i++)
+	{
+		if (crc && i % plen >= dlen)
+			continue;
+		b = fgetc(in);
+		n++;
+		bad += a != b;
+	}
+	fclose(in);
+	fclose(data);
+	printf("%ld bytes, %ld wrong\n", n, bad);
+	return 0;
+}
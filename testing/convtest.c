@@ -0,0 +1,67 @@
+#include "fec.c"
+
+// convtest in conv scrambled out
+// each rate: conv, bit errors (1 in 2^7 hard, then soft symbols with
+// noise), d_conv, and the bytes that came out wrong
+
+static long wrong(const char *a, const char *b)
+{
+	FILE *fa = fopen(a,"rb"), *fb = fopen(b,"rb");
+	long bad = 0;
+	int x;
+	while ((x = fgetc(fa)) != EOF)
+		bad += x != fgetc(fb);
+	fclose(fa);
+	fclose(fb);
+	return bad;
+}
+
+int main(int argc, char *argv[])
+{
+	for (int rate = CONV_12; rate <= CONV_34; rate++)
+	{
+		FILE *in = fopen(argv[1],"rb");
+		FILE *out = fopen(argv[2],"wb");
+		int frames = conv(rate,in,out);
+		fclose(in);
+		fclose(out);
+
+		in = fopen(argv[2],"rb");
+		out = fopen(argv[3],"wb");
+		scram(7,in,out);
+		fclose(in);
+		fclose(out);
+
+		in = fopen(argv[3],"rb");
+		out = fopen(argv[4],"wb");
+		d_conv(rate,0,in,out);
+		fclose(in);
+		fclose(out);
+		printf("rate %d: %d frames, hard %ld wrong", rate, frames, wrong(argv[1], argv[4]));
+
+		// soft: 64 for 0, 192 for 1, plus noise of up to +-80 (1 in 10 on the wrong side of 128)
+		int nsym = conv_nsym(rate);
+		size_t flen = (nsym + 7) / 8;
+		unsigned char raw[flen];
+		srand(1);
+		in = fopen(argv[2],"rb");
+		out = fopen(argv[3],"wb");
+		while (fread(raw, 1, flen, in) == flen)
+			for (int i = 0; i < nsym; i++)
+			{
+				int s = (raw[i / 8] >> (7 - i % 8)) & 1 ? 192 : 64;
+				s += rand() % 161 - 80;
+				fputc(s < 0 ? 0 : s > 255 ? 255 : s, out);
+			}
+		fclose(in);
+		fclose(out);
+
+		in = fopen(argv[3],"rb");
+		out = fopen(argv[4],"wb");
+		d_conv(rate,1,in,out);
+		fclose(in);
+		fclose(out);
+		printf(", soft %ld wrong\n", wrong(argv[1], argv[4]));
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include "fec.c"
+
+// crctest in rskm udp scrambled erased out
+// rskm(8, 4) packets get CRC-32C trailers, then bit errors; decUDPcrc
+// turns every packet with a bad CRC into an erasure, so d_rskm should
+// give back the file exactly (in padded out to whole groups) as long as
+// no group loses more than 4 packets
+int main(int argc, char *argv[])
+{
+	FILE *in = fopen(argv[1],"rb");
+	FILE *out = fopen(argv[2],"wb");
+	int pnum = rskm(8,4,996,0,in,out) * 12;
+	fclose(in);
+	fclose(out);
+	printf("pnum: %d\n", pnum);
+
+	in = fopen(argv[2],"rb");
+	out = fopen(argv[3],"wb");
+	inlvUDPcrc(1000,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[3],"rb");
+	out = fopen(argv[4],"wb");
+	scram(16,in,out);
+	fclose(in);
+	fclose(out);
+
+	unsigned char *eras = calloc(pnum, 1);
+	in = fopen(argv[4],"rb");
+	out = fopen(argv[5],"wb");
+	printf("erased: %d\n", decUDPcrc(pnum,1000,eras,in,out));
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[5],"rb");
+	out = fopen(argv[6],"wb");
+	printf("recovered: %d\n", d_rskm(8,4,996,pnum,eras,in,out));
+	fclose(in);
+	fclose(out);
+	free(eras);
+
+	// wrong bytes
+	long bad = 0, n = 0;
+	int a, b;
+	in = fopen(argv[1],"rb");
+	out = fopen(argv[6],"rb");
+	while ((a = fgetc(in)) != EOF)
+	{
+		b = fgetc(out);
+		n++;
+		bad += a != b;
+	}
+	fclose(in);
+	fclose(out);
+	printf("%ld bytes, %ld wrong\n", n, bad);
+	return 0;
+}
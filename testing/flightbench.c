@@ -0,0 +1,204 @@
+#include "fec.c"
+#include "fec_flight.c"
+#include <ucontext.h>
+
+/* Host numbers for the flight encoders (fec_flight.c):
+ *   stack   - deepest stack use: the codec runs (makecontext) on a stack
+ *             that is a painted static buffer, less what getting onto
+ *             that stack and back uses on its own
+ *   buffers - what the caller has to provide for that configuration
+ *   cyc/B   - cycles per input byte (TSC on x86, else ns per byte)
+ * and a check that each one writes what the stdio version writes.
+ *
+ * gcc -O2 -I. -pthread testing/flightbench.c -o flightbench
+ * Build with -DFL_MAXPLEN=... to match the flight build.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define UNIT "cyc/B"
+static unsigned long long ticks(void)
+{
+	return __rdtsc();
+}
+#else
+#define UNIT "ns/B"
+static unsigned long long ticks(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+#define PAINT	16384
+#define REPS	200
+
+static unsigned char src[4 * FL_MAXPLEN * FL_MAXKM];
+static unsigned char dst[8 * FL_MAXPLEN * FL_MAXKM];
+
+struct cfg {
+	int what;	// 0 h74, 1 inlvham, 2 h74inlv, 3 udp, 4 rskm, 5 rnd
+	unsigned int plen;
+	int k, m;
+};
+
+static void __attribute__((noinline)) run(const struct cfg *c)
+{
+	switch (c->what)
+	{
+	case 0: fl_h74(src, 4 * c->plen, dst); break;
+	case 1: fl_inlvham(c->plen, src, dst); break;
+	case 2: fl_h74inlv(c->plen, src, dst); break;
+	case 3: fl_udp(c->plen, src, c->plen, dst); break;
+	case 4: fl_rskm(c->k, c->m, c->plen, src, dst); break;
+	case 5: memcpy(dst, src, c->plen); fl_rnd(dst, c->plen); break;
+	}
+}
+
+static unsigned char stk[PAINT] __attribute__((aligned(64)));
+static const struct cfg *oncfg;
+static ucontext_t back, there;
+
+static void onstack(void)
+{
+	if (oncfg != NULL)
+		run(oncfg);
+}
+
+// how much of stk running c (or nothing) on it wrote, top down
+static int painted(const struct cfg *c)
+{
+	int i = 0;
+
+	memset(stk, 0xa5, sizeof(stk));
+	oncfg = c;
+	getcontext(&there);
+	there.uc_stack.ss_sp = stk;
+	there.uc_stack.ss_size = sizeof(stk);
+	there.uc_link = &back;
+	makecontext(&there, onstack, 0);
+	swapcontext(&back, &there);
+	while (i < PAINT && stk[i] == 0xa5)
+		i++;
+	return PAINT - i;
+}
+
+static size_t inbytes(const struct cfg *c)
+{
+	switch (c->what)
+	{
+	case 0: case 2: return 4 * c->plen;
+	case 1: return 7 * c->plen;
+	case 3: case 5: return c->plen;
+	default: return (size_t) c->k * c->plen;
+	}
+}
+
+static size_t outbytes(const struct cfg *c)
+{
+	switch (c->what)
+	{
+	case 0: case 1: case 2: return 7 * c->plen;
+	case 3: return c->plen + 8;
+	case 5: return 0;	// in place
+	default: return (size_t) c->m * c->plen;
+	}
+}
+
+// what the stdio version writes for the same input
+static int same(const struct cfg *c)
+{
+	size_t in = inbytes(c), out = outbytes(c);
+	char *buf;
+	size_t len;
+	FILE *fi = fmemopen(src, in, "rb");
+	FILE *fo = open_memstream(&buf, &len);
+
+	switch (c->what)
+	{
+	case 0: h74(fi, fo); break;
+	case 1: inlvham(c->plen, fi, fo); break;
+	case 2:
+	{
+		char *hb;
+		size_t hl;
+		FILE *h = open_memstream(&hb, &hl);
+		h74(fi, h);
+		fclose(h);
+		FILE *hi = fmemopen(hb, 7 * c->plen, "rb");
+		inlvham(c->plen, hi, fo);
+		fclose(hi);
+		free(hb);
+		break;
+	}
+	case 3: addUDP(c->plen, fo); fwrite(src, 1, c->plen, fo); break;
+	case 4: rskm(c->k, c->m, c->plen, 1, fi, fo); break;
+	case 5: rnd(c->plen, fi, fo); break;
+	}
+	fclose(fi);
+	fclose(fo);
+
+	// rskm writes data then parity; the streams may add a last padding word
+	const char *ref = buf + (c->what == 4 ? in : 0);
+	run(c);
+	if (c->what == 5)
+		out = c->plen;
+	int ok = len >= out && memcmp(ref, dst, out) == 0;
+	free(buf);
+	return ok;
+}
+
+int main(void)
+{
+	static const char *name[] = {"h74", "inlvham", "h74inlv", "udp", "rskm", "rnd"};
+	struct cfg cfgs[64];
+	int n = 0;
+	unsigned int plens[] = {64, 256, FL_MAXPLEN};
+
+	for (int p = 0; p < 3; p++)
+	{
+		for (int w = 0; w < 4; w++)
+			cfgs[n++] = (struct cfg) {w, plens[p], 0, 0};
+		cfgs[n++] = (struct cfg) {4, plens[p], 4, 2};
+		cfgs[n++] = (struct cfg) {4, plens[p], 8, 4};
+		cfgs[n++] = (struct cfg) {4, plens[p], 16, 8};
+		cfgs[n++] = (struct cfg) {5, plens[p], 0, 0};
+	}
+
+	srand(1);
+	for (size_t i = 0; i < sizeof(src); i++)
+		src[i] = (unsigned char) rand();
+
+	printf("FL_MAXPLEN %d, FL_MAXKM %d, static RAM 0 B (tables in flash: %zu B)\n\n",
+		FL_MAXPLEN, FL_MAXKM, sizeof(fl_exp) + sizeof(fl_log)
+		+ sizeof(fl_rnd_tab));
+	printf("%-8s %5s %6s %6s %8s %8s %4s\n",
+		"codec", "plen", "k,m", "stack", "buffers", UNIT, "same");
+	int base = painted(NULL);
+	for (int i = 0; i < n; i++)
+	{
+		const struct cfg *c = &cfgs[i];
+
+		run(c);	// once first, so lazy symbol binding isn't counted
+		int stack = painted(c) - base;
+
+		unsigned long long best = ~0ull;
+		for (int r = 0; r < REPS; r++)
+		{
+			unsigned long long t = ticks();
+			run(c);
+			t = ticks() - t;
+			if (t < best)
+				best = t;
+		}
+
+		char km[16] = "-";
+		if (c->what == 4)
+			snprintf(km, sizeof(km), "%d,%d", c->k, c->m);
+		printf("%-8s %5u %6s %6d %8zu %8.2f %4s\n", name[c->what], c->plen, km,
+			stack, inbytes(c) + outbytes(c), (double) best / inbytes(c),
+			same(c) ? "yes" : "NO");
+	}
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include "fec.c"
+
+// h74ntest in coded damaged out
+// nibble Hamming, plain and secded: one bad bit in every codeword must
+// be fixed; with secded, two bad bits in every 5th codeword must be
+// counted (and only those), the rest still fixed.
+
+// Flip bit (i * 3) % 8 of every codeword, and with two, also bit
+// (i * 3 + 4) % 8 of every 5th; returns how many got two
+static long damage(const char *from, const char *to, int two, int bits)
+{
+	FILE *in = fopen(from,"rb");
+	FILE *out = fopen(to,"wb");
+	long i = 0, n2 = 0;
+	int c;
+	while ((c = fgetc(in)) != EOF)
+	{
+		c ^= 1 << (i * 3 % bits);
+		if (two && i % 5 == 0)
+		{
+			c ^= 1 << ((i * 3 + 4) % bits);
+			n2++;
+		}
+		fputc(c, out);
+		i++;
+	}
+	fclose(in);
+	fclose(out);
+	return n2;
+}
+
+static long wrong(const char *a, const char *b)
+{
+	FILE *fa = fopen(a,"rb"), *fb = fopen(b,"rb");
+	long bad = 0;
+	int x;
+	while ((x = fgetc(fa)) != EOF)
+		bad += x != fgetc(fb);
+	bad += fgetc(fb) != EOF;
+	fclose(fa);
+	fclose(fb);
+	return bad;
+}
+
+int main(int argc, char *argv[])
+{
+	for (int secded = 0; secded <= 1; secded++)
+	{
+		FILE *in = fopen(argv[1],"rb");
+		FILE *out = fopen(argv[2],"wb");
+		h74n(secded,in,out);
+		fclose(in);
+		fclose(out);
+
+		// 7 bit codewords: bit 7 is left alone without secded
+		damage(argv[2], argv[3], 0, secded ? 8 : 7);
+		in = fopen(argv[3],"rb");
+		out = fopen(argv[4],"wb");
+		int bad = d_h74n(secded,in,out);
+		fclose(in);
+		fclose(out);
+		printf("secded %d, one bad bit each: %d found bad, %ld bytes wrong\n",
+			secded, bad, wrong(argv[1], argv[4]));
+	}
+
+	long n2 = damage(argv[2], argv[3], 1, 8);
+	FILE *in = fopen(argv[3],"rb");
+	FILE *out = fopen(argv[4],"wb");
+	int bad = d_h74n(1,in,out);
+	fclose(in);
+	fclose(out);
+
+	// the bytes whose codewords got one bad bit must be right
+	FILE *a = fopen(argv[1],"rb"), *b = fopen(argv[4],"rb");
+	long wrong1 = 0;
+	int x;
+	for (long i = 0; (x = fgetc(a)) != EOF; i++)
+	{
+		int y = fgetc(b);
+		if ((2 * i) % 5 != 0 && (2 * i + 1) % 5 != 0)
+			wrong1 += x != y;
+	}
+	fclose(a);
+	fclose(b);
+	printf("secded 1, two bad bits in %ld codewords: %d found bad, %ld wrong elsewhere\n",
+		n2, bad, wrong1);
+	return 0;
+}
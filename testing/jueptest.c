@@ -0,0 +1,131 @@
+#include "fec.c"
+
+// jueptest image.jpeg out
+// jpeg_uep, packets dropped, d_jpeg_uep, on the image and on a copy of it
+// with restart markers put into its first scan (DRI and RSTn every 300
+// bytes; it won't display right, but it splits the way such a file
+// does). For each: no loss, one scan packet lost from each rskm group in
+// turn (the last group is partly padding), one header packet lost, all
+// of which must give the file back exactly; then m + 1 scan packets lost
+// from one group, which must only cost scan bytes.
+
+#define PLEN	200
+#define FLEN	(PLEN + BATCH_HDR + 8)
+
+static const struct uepcfg cfg = { PLEN, 8, 4, 4, 4 };
+
+// The coded stream without count packets of stream sid from seq on
+static FILE *drop(FILE *coded, unsigned int sid, uint32_t seq, int count)
+{
+	unsigned char f[FLEN];
+	FILE *t = tmpfile();
+	rewind(coded);
+	while (fread(f, 1, FLEN, coded) == FLEN)
+	{
+		unsigned int s = f[8] | f[9] << 8;
+		uint32_t q = f[10] | f[11] << 8 | f[12] << 16 | (uint32_t) f[13] << 24;
+		if (s == sid && q >= seq && q < seq + count)
+			continue;
+		fwrite(f, 1, FLEN, t);
+	}
+	rewind(t);
+	return t;
+}
+
+// d_jpeg_uep what's left; returns bytes that differ from img (or -1)
+static long check(FILE *rx, const unsigned char *img, size_t len, const char *path)
+{
+	FILE *out = fopen(path,"wb");
+	int r = d_jpeg_uep(&cfg, rx, out);
+	fclose(out);
+	fclose(rx);
+	if (r < 0)
+		return -1;
+
+	size_t got;
+	out = fopen(path,"rb");
+	unsigned char *d = slurp(out, &got);
+	fclose(out);
+	long bad = got != len ? 1 : 0;
+	for (size_t i = 0; i < len && i < got; i++)
+		bad += d[i] != img[i];
+	free(d);
+	return bad;
+}
+
+static void run(const char *name, const unsigned char *img, size_t len, const char *path)
+{
+	FILE *in = tmpfile(), *coded = tmpfile();
+	fwrite(img, 1, len, in);
+	rewind(in);
+	long long pnum = jpeg_uep(&cfg, in, coded);
+	fclose(in);
+
+	// packets per stream
+	unsigned char f[FLEN];
+	uint32_t np[2] = { 0, 0 };
+	rewind(coded);
+	while (fread(f, 1, FLEN, coded) == FLEN)
+		np[f[8] & 1]++;
+	int n = cfg.k + cfg.m, groups = np[1] / n;
+	printf("%s: %zu bytes, %lld packets (%u headers, %u scan, %d groups)\n",
+		name, len, pnum, np[0], np[1], groups);
+
+	printf("  no loss: %ld wrong\n", check(drop(coded, 1, 0, 0), img, len, path));
+	int exact = 0;
+	for (int g = 0; g < groups; g++)
+	{
+		long bad = check(drop(coded, 1, g * n + 1, 1), img, len, path);
+		exact += bad == 0;
+		if (g == groups - 1)
+			printf("  one scan packet lost, last group: %ld wrong\n", bad);
+	}
+	printf("  one scan packet lost: %d of %d groups exact\n", exact, groups);
+	printf("  one header packet lost: %ld wrong\n", check(drop(coded, 0, 1, 1), img, len, path));
+	printf("  %d scan packets lost from group 0: %ld wrong\n", cfg.m + 1,
+		check(drop(coded, 1, 0, cfg.m + 1), img, len, path));
+	fclose(coded);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t len;
+	FILE *in = fopen(argv[1],"rb");
+	unsigned char *img = slurp(in, &len);
+	fclose(in);
+	run(argv[1], img, len, argv[2]);
+
+	// DRI after SOI, RSTn into the first scan
+	unsigned char *rst = malloc(2 * len + 6);
+	size_t o = 0, i = 2;
+	memcpy(rst, img, 2);
+	o = 2;
+	const unsigned char dri[6] = { 0xff, 0xdd, 0x00, 0x04, 0x00, 0x10 };
+	memcpy(rst + o, dri, 6);
+	o += 6;
+	while (i + 1 < len && !(img[i] == 0xff && img[i+1] == 0xda))
+		rst[o++] = img[i++];
+	size_t seg = 2 + (img[i+2] << 8 | img[i+3]);
+	memcpy(rst + o, img + i, seg);
+	o += seg;
+	i += seg;
+	int mark = 0, run_ = 0;
+	while (i + 1 < len && !(img[i] == 0xff && img[i+1] != 0x00 && (img[i+1] < 0xd0 || img[i+1] > 0xd7)))
+	{
+		if (++run_ >= 300 && img[i-1] != 0xff && img[i] != 0xff)
+		{
+			rst[o++] = 0xff;
+			rst[o++] = (unsigned char) (0xd0 + mark++ % 8);
+			run_ = 0;
+		}
+		rst[o++] = img[i++];
+	}
+	memcpy(rst + o, img + i, len - i);
+	o += len - i;
+	printf("%d restart markers\n", mark);
+	run("with restart markers", rst, o, argv[2]);
+
+	free(rst);
+	free(img);
+	return 0;
+}
@@ -0,0 +1,81 @@
+#include "fec.c"
+
+// maptest in a b
+// the mapped versions must write exactly what the stream versions do:
+// fecmap with the rs255 stage against rs255, fecmap_udp against inlvUDP,
+// fecmap_d_udp against decUDP (on UDP with every 5th header damaged),
+// for in and for an empty file. a and b are scratch files.
+
+static const char *same(const char *a, const char *b)
+{
+	FILE *fa = fopen(a,"rb"), *fb = fopen(b,"rb");
+	int x, y;
+	do
+	{
+		x = fgetc(fa);
+		y = fgetc(fb);
+	} while (x == y && x != EOF);
+	fclose(fa);
+	fclose(fb);
+	return x == y ? "same" : "DIFFERENT";
+}
+
+static void run(const char *path, const char *a, const char *b)
+{
+	struct fecstage rs = { fecblk_rs255, (void *) 4, 223 * 4, 255 * 4 };
+	char udp[] = "/tmp/maptestXXXXXX";
+	close(mkstemp(udp));
+
+	FILE *in = fopen(path,"rb");
+	FILE *out = fopen(a,"wb");
+	rs255(4,in,out);
+	fclose(in);
+	fclose(out);
+	long long n = fecmap(&rs, path, b);
+	printf("  rs255: %lld bytes, %s\n", n, same(a, b));
+
+	in = fopen(path,"rb");
+	out = fopen(a,"wb");
+	int pnum = inlvUDP(1000,in,out);
+	fclose(in);
+	fclose(out);
+	n = fecmap_udp(1000, path, b);
+	printf("  inlvUDP: %d / %lld packets, %s\n", pnum, n, same(a, b));
+
+	// damage every 5th header
+	unsigned char f[1008];
+	in = fopen(a,"rb");
+	out = fopen(udp,"wb");
+	for (int i = 0; fread(f, 1, 1008, in) == 1008; i++)
+	{
+		if (i % 5 == 2)
+			f[4] ^= 0x01;	// length
+		fwrite(f, 1, 1008, out);
+	}
+	fclose(in);
+	fclose(out);
+
+	in = fopen(udp,"rb");
+	out = fopen(a,"wb");
+	int dropped = decUDP(pnum,1000,in,out);
+	fclose(in);
+	fclose(out);
+	uint64_t mdropped;
+	n = fecmap_d_udp(1000, udp, b, &mdropped);
+	printf("  decUDP: %d / %llu dropped, %lld packets, %s\n",
+		dropped, (unsigned long long) mdropped, n, same(a, b));
+	unlink(udp);
+}
+
+int main(int argc, char *argv[])
+{
+	printf("%s:\n", argv[1]);
+	run(argv[1], argv[2], argv[3]);
+
+	char empty[] = "/tmp/maptestXXXXXX";
+	close(mkstemp(empty));
+	printf("empty file:\n");
+	run(empty, argv[2], argv[3]);
+	unlink(empty);
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include "fec.c"
+
+// pipetest in coded udp scrambled dropped out [workers]
+// rs255 then h74 through the pipeline, UDP with bit errors, and back
+// through the pipeline; prints how full the rings got
+static void occ(struct fecpipe *p, int nw)
+{
+	struct fecocc o[2 * nw];
+	int n = fecpipe_occ(p, o, 2 * nw);
+	for (int i = 0; i < n; i++)
+		printf("  ring %d: hiwater %u/%u, full waits %lu, empty waits %lu\n",
+			i, o[i].hiwater, o[i].nslots, o[i].fullwait, o[i].emptywait);
+}
+
+int main(int argc, char *argv[])
+{
+	int nw = argc > 7 ? atoi(argv[7]) : 4;
+	struct fecstage enc[] = {
+		{ fecblk_rs255, (void *) 4, 223 * 4, 255 * 4 },
+		{ fecblk_h74, NULL, 255 * 4, 255 * 7 },
+	};
+	struct fecstage dec[] = {
+		{ fecblk_d_h74, NULL, 255 * 7, 255 * 4 },
+		{ fecblk_d_rs255, (void *) 4, 255 * 4, 255 * 4 },
+	};
+
+	FILE *in = fopen(argv[1],"rb");
+	FILE *out = fopen(argv[2],"wb");
+	struct fecpipe *p = fecpipe_new(enc, 2, nw, 8);
+	printf("encoded: %lld\n", fecpipe_run(p, in, out));
+	occ(p, nw);
+	fecpipe_free(p);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[2],"rb");
+	out = fopen(argv[3],"wb");
+	int pnum = inlvUDP(1000,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[3],"rb");
+	out = fopen(argv[4],"wb");
+	scram(10,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[4],"rb");
+	out = fopen(argv[5],"wb");
+	printf("dropped: %d\n", decUDP(pnum,1000,in,out));
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[5],"rb");
+	out = fopen(argv[6],"wb");
+	p = fecpipe_new(dec, 2, nw, 8);
+	printf("decoded: %lld\n", fecpipe_run(p, in, out));
+	occ(p, nw);
+	fecpipe_free(p);
+	fclose(in);
+	fclose(out);
+	return 0;
+}
@@ -0,0 +1,115 @@
+#include "fec.c"
+
+// plentest in out
+// tuneplen over a clean and a bursty lossy channel; the pick must be in
+// [pmin, pmax]. Then setplen to the last pick and round trips with
+// plen 0 everywhere: rskm, bilv, UDP with one packet dropped per group
+// and back; prod and d_prod; batchenc and demux; a session. out is the
+// rskm round trip, which must be in exactly.
+
+static long wrong(const char *path, FILE *f, long len)
+{
+	FILE *in = fopen(path,"rb");
+	long bad = 0;
+	int a;
+	rewind(f);
+	for (long i = 0; i < len && (a = fgetc(in)) != EOF; i++)
+		bad += a != fgetc(f);
+	fclose(in);
+	return bad;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct fecchan ch[2] = {
+		{ 1e-5, 1, 0.001 },
+		{ 1e-4, 20, 0.02 },
+	};
+	const unsigned int pmin = 64, pmax = 4000;
+	struct plentune best;
+
+	for (int c = 0; c < 2; c++)
+	{
+		int r = tuneplen(&ch[c], 1e-4, pmin, pmax, 32, &best);
+		printf("channel %d: %d, plen %u, k %d m %d, eff %.3f (sim %.3f), %s\n",
+			c, r, best.plen, best.k, best.m, best.eff, best.sim,
+			best.plen >= pmin && best.plen <= pmax ? "in range" : "OUT OF RANGE");
+	}
+	setplen(best.plen);
+	printf("getplen: %u\n", getplen());
+
+	FILE *in = fopen(argv[1],"rb");
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	rewind(in);
+
+	// rskm, bilv, UDP, one packet per group dropped, and back
+	int k = best.k, m = best.m, n = best.k + best.m;
+	FILE *t1 = tmpfile(), *t2 = tmpfile(), *t3 = tmpfile();
+	int pnum = rskm(k,m,0,0,in,t1) * n;
+	rewind(t1);
+	bilv(8,0,t1,t2);
+	rewind(t2);
+	rewind(t3);
+	inlvUDP(0,t2,t3);
+	unsigned int flen = getplen() + 8;
+	unsigned char *f = malloc(flen);
+	unsigned char *eras = calloc(pnum, 1);	// rskm's padding is 0s too
+	rewind(t3);
+	FILE *t4 = tmpfile();
+	for (int i = 0; fread(f, 1, flen, t3) == flen; i++)
+	{
+		if (i % n == 1)
+		{
+			f[3] ^= 0x01;	// dest port
+			eras[i] = 1;
+		}
+		fwrite(f, 1, flen, t4);
+	}
+	rewind(t4);
+	FILE *t5 = tmpfile(), *t6 = tmpfile();
+	printf("rskm: %d packets, %d dropped", pnum, decUDP(pnum,0,t4,t5));
+	rewind(t5);
+	d_bilv(8,0,t5,t6);
+	rewind(t6);
+	FILE *out = fopen(argv[2],"w+b");
+	d_rskm(k,m,0,pnum,eras,t6,out);
+	printf(", %ld wrong\n", wrong(argv[1], out, size));
+
+	// prod
+	FILE *p1 = tmpfile(), *p2 = tmpfile();
+	rewind(in);
+	int ppnum = prod(8,4,PROD_RS,8,0,in,p1);
+	rewind(p1);
+	printf("prod: %d packets, %d erased", ppnum, d_prod(8,4,PROD_RS,8,0,ppnum,NULL,2,2,p1,p2));
+	printf(", %s\n", ppnum > 0 ? "ok" : "FAILED");
+
+	// batchenc, demux
+	struct fecjob job = { argv[1], 1, 0, { NULL, NULL, 0, 0 }, 0, 0 };
+	FILE *b1 = tmpfile(), *b2 = tmpfile();
+	long long bpnum = batchenc(&job, 1, 0, 2, b1);
+	rewind(b1);
+	uint64_t lost;
+	demux(0, b1, &b2, 1, &lost, NULL);
+	printf("batch: %lld packets, %llu lost, %ld wrong\n", bpnum,
+		(unsigned long long) lost, wrong(argv[1], b2, size));
+
+	// session
+	char path[] = "/tmp/plentestXXXXXX";
+	close(mkstemp(path));
+	unlink(path);
+	struct fecsess *s = sess_open(path, k, m, 0);
+	rewind(t5);
+	long long kept = sess_addstream(s, 0, pnum, NULL, t5);
+	sess_close(s);
+	s = sess_open(path, k, m, 0);	// same plen, so it must open
+	printf("session: %lld kept, reopened %s\n", kept, s != NULL ? "ok" : "FAILED");
+	sess_close(s);
+	unlink(path);
+
+	fclose(in);
+	fclose(out);
+	free(eras);
+	free(f);
+	return 0;
+}
@@ -0,0 +1,85 @@
+#include "fec.c"
+
+// prodtest in prod udp scrambled dropped out [inner]
+// product code (inner 1 Hamming, 2 RS) through UDP with bit errors;
+// d_prod goes one round, then six, to show what iterating buys; then
+// the largest plen (rows of 257 interleaved RS codewords), with two
+// packets dropped
+int main(int argc, char *argv[])
+{
+	int inner = argc > 7 ? atoi(argv[7]) : PROD_RS;
+
+	FILE *in = fopen(argv[1],"rb");
+	FILE *out = fopen(argv[2],"wb");
+	int pnum = prod(8,4,inner,8,350,in,out);
+	fclose(in);
+	fclose(out);
+	printf("pnum: %d\n", pnum);
+
+	in = fopen(argv[2],"rb");
+	out = fopen(argv[3],"wb");
+	inlvUDP(350,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[3],"rb");
+	out = fopen(argv[4],"wb");
+	scram(12,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[4],"rb");
+	out = fopen(argv[5],"wb");
+	printf("dropped: %d\n", decUDP(pnum,350,in,out));
+	fclose(in);
+	fclose(out);
+
+	for (int iters = 1; iters <= 6; iters += 5)
+	{
+		in = fopen(argv[5],"rb");
+		out = fopen(argv[6],"wb");
+		int left = d_prod(8,4,inner,8,350,pnum,NULL,iters,4,in,out);
+		printf("iters %d: %d bytes still erased\n", iters, left);
+		fclose(in);
+		fclose(out);
+	}
+
+	unsigned int big = 65535;
+	unsigned char *pkt = malloc(big);
+	FILE *data = tmpfile();
+	for (long i = 0; i < 4L * 256 * 250; i++)
+		fputc(rand(), data);
+	rewind(data);
+	FILE *coded = tmpfile();
+	pnum = prod(4,2,PROD_RS,16,big,data,coded);
+	rewind(coded);
+	FILE *recv = tmpfile();
+	unsigned char *eras = calloc(pnum, 1);	// the padding rows are 0s too
+	for (int i = 0; i < pnum; i++)
+	{
+		fread(pkt, 1, big, coded);
+		if (i == 1 || i == 4)
+		{
+			memset(pkt, 0, big);
+			eras[i] = 1;
+		}
+		fwrite(pkt, 1, big, recv);
+	}
+	rewind(recv);
+	FILE *dec = tmpfile();
+	int left = d_prod(4,2,PROD_RS,16,big,pnum,eras,2,4,recv,dec);
+	rewind(data);
+	rewind(dec);
+	long bad = 0;
+	int a;
+	while ((a = fgetc(data)) != EOF)
+		bad += a != fgetc(dec);
+	printf("plen %u: %d packets, %d bytes still erased, %ld wrong\n", big, pnum, left, bad);
+	fclose(data);
+	fclose(coded);
+	fclose(recv);
+	fclose(dec);
+	free(eras);
+	free(pkt);
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include "fec.c"
+
+// rndtest in rnd udp damaged dropped out
+// the CCSDS sequence must start ff 48 0e c0 9a; then in goes through
+// rnd and UDP, every 7th packet gets a bad header (so decUDP drops it),
+// and d_rnd. Every packet of out should be the one sent or, if it was
+// dropped, all 0s (not the sequence).
+int main(int argc, char *argv[])
+{
+	const unsigned char pn[5] = { 0xff, 0x48, 0x0e, 0xc0, 0x9a };
+	unsigned char z[8] = { 0 };
+	rndblk(z, sizeof(z));
+	printf("sequence: %02x %02x %02x %02x %02x, %s\n", z[0], z[1], z[2], z[3], z[4],
+		memcmp(z, pn, 5) ? "WRONG" : "ok");
+
+	FILE *in = fopen(argv[1],"rb");
+	FILE *out = fopen(argv[2],"wb");
+	rnd(500,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[2],"rb");
+	out = fopen(argv[3],"wb");
+	int pnum = inlvUDP(500,in,out);
+	fclose(in);
+	fclose(out);
+	printf("pnum: %d\n", pnum);
+
+	unsigned char a[508], b[508];
+	in = fopen(argv[3],"rb");
+	out = fopen(argv[4],"wb");
+	for (int i = 0; fread(a, 1, 508, in) == 508; i++)
+	{
+		if (i % 7 == 3)
+			a[2] ^= 0x10;	// dest port
+		fwrite(a, 1, 508, out);
+	}
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[4],"rb");
+	out = fopen(argv[5],"wb");
+	printf("dropped: %d\n", decUDP(pnum,500,in,out));
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[5],"rb");
+	out = fopen(argv[6],"wb");
+	d_rnd(500,in,out);
+	fclose(in);
+	fclose(out);
+
+	// packet by packet: as sent, all 0s, or neither
+	int same = 0, zero = 0, bad = 0;
+	size_t got;
+	in = fopen(argv[1],"rb");
+	out = fopen(argv[6],"rb");
+	while ((got = fread(a, 1, 500, in)) > 0)
+	{
+		fread(b, 1, 500, out);
+		if (memcmp(a, b, got) == 0)
+			same++;
+		else if (b[0] == 0 && memcmp(b, b + 1, got - 1) == 0)
+			zero++;
+		else
+			bad++;
+	}
+	fclose(in);
+	fclose(out);
+	printf("packets: %d as sent, %d dropped (0s), %d neither\n", same, zero, bad);
+	return 0;
+}
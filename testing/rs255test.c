@@ -0,0 +1,75 @@
+#include "fec.c"
+
+// rs255test in rs255 scrambled out
+// rs255 (depth 4) with bit errors over the file, then d_rs255; after
+// that rsblk_dec on random blocks with e errors and f erasures, up to
+// and one past what nroots can fix (2e + f <= nroots)
+int main(int argc, char *argv[])
+{
+	FILE *in = fopen(argv[1],"rb");
+	FILE *out = fopen(argv[2],"wb");
+	printf("rs255: %d\n", rs255(4,in,out));
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[2],"rb");
+	out = fopen(argv[3],"wb");
+	scram(9,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[3],"rb");
+	out = fopen(argv[4],"wb");
+	printf("d_rs255: %d codewords not corrected\n", d_rs255(4,in,out));
+	fclose(in);
+	fclose(out);
+
+	int nroots = 16, n = 255, depth = 4;
+	unsigned char blk[255 * 4], sent[255 * 4], eras[255 * 4];
+	int res[4];
+
+	srand(1);
+	for (int over = 0; over <= 1; over++)
+		for (int f = 0; f <= nroots; f += 4)
+		{
+			int e = (nroots - f) / 2 + over;
+			int fixed = 0, failed = 0, wrong = 0;
+			for (int t = 0; t < 200; t++)
+			{
+				for (int i = 0; i < (n - nroots) * depth; i++)
+					blk[i] = (unsigned char) rand();
+				rsblk_enc(nroots, n, depth, blk);
+				memcpy(sent, blk, sizeof(blk));
+				memset(eras, 0, sizeof(eras));
+
+				// e + f distinct symbols of each codeword
+				for (int c = 0; c < depth; c++)
+				{
+					unsigned char hit[255] = { 0 };
+					for (int k = 0; k < e + f; k++)
+					{
+						int i;
+						do
+							i = rand() % n;
+						while (hit[i]);
+						hit[i] = 1;
+						blk[i * depth + c] ^= (unsigned char) (1 + rand() % 255);
+						if (k < f)
+							eras[i * depth + c] = 1;
+					}
+				}
+				failed += rsblk_dec(nroots, n, depth, blk, eras, res);
+				for (int c = 0; c < depth; c++)
+				{
+					int ok = 1;
+					for (int i = 0; i < n; i++)
+						ok &= blk[i * depth + c] == sent[i * depth + c];
+					fixed += ok;
+					wrong += !ok && res[c] >= 0;
+				}
+			}
+			printf("%d errors %2d erasures: %d fixed, %d failed, %d wrong\n",
+				e, f, fixed, failed, wrong);
+		}
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include "fec.c"
+
+// rskmtest in rskm udp scrambled dropped out
+// planpass picks rskm k, m for a 10 minute pass at 9600 bit/s; the file
+// goes through it, UDP and bit errors, d_rskm fills in the dropped
+// packets, and mctrl says what m the next block should get. Bit errors
+// that get past decUDP stay in: check out against in with bitcmp.
+int main(int argc, char *argv[])
+{
+	struct passplan plan;
+	FILE *in = fopen(argv[1],"rb");
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	rewind(in);
+
+	planpass(600, 9600, 1e-4, 0.01, size, 1000, &plan);
+	printf("plan: codec %d k %d m %d, rate %.3f, goodput %.4f\n",
+		plan.codec, plan.k, plan.m, plan.rate, plan.goodput);
+	if (plan.codec != PLAN_RS)
+	{	// still test rskm
+		plan.k = 8;
+		plan.m = 4;
+	}
+
+	FILE *out = fopen(argv[2],"wb");
+	int groups = rskm(plan.k,plan.m,1000,0,in,out);
+	int pnum = groups * (plan.k + plan.m);
+	fclose(in);
+	fclose(out);
+	printf("pnum: %d\n", pnum);
+
+	in = fopen(argv[2],"rb");
+	out = fopen(argv[3],"wb");
+	inlvUDP(1000,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[3],"rb");
+	out = fopen(argv[4],"wb");
+	scram(12,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[4],"rb");
+	out = fopen(argv[5],"wb");
+	int dropped = decUDP(pnum,1000,in,out);
+	fclose(in);
+	fclose(out);
+	printf("dropped: %d\n", dropped);
+
+	in = fopen(argv[5],"rb");
+	out = fopen(argv[6],"wb");
+	printf("recovered: %d\n", d_rskm(plan.k,plan.m,1000,pnum,NULL,in,out));
+	fclose(in);
+	fclose(out);
+
+	struct mctrl c;
+	mctrl_init(&c, plan.k, 1, 16, 1e-4);
+	printf("next m: %d\n", mctrl_update(&c, dropped, pnum));
+
+	// the tail of the last group is padding
+	truncate(argv[6], size);
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include "fec.c"
+
+// sesstest in rskm udp scrambled erased sessfile out
+// rskm(8, 4) with CRC trailers heard on two passes: the first with so
+// many bit errors that most groups can't be decoded, kept in a session
+// file; the second, after closing and opening it again, fills in what
+// the first was missing. out should be in (padded to whole groups).
+
+static void pass(const char *sess, int n, int pnum, char *argv[])
+{
+	FILE *in = fopen(argv[3],"rb");
+	FILE *out = fopen(argv[4],"wb");
+	scram(n,in,out);
+	fclose(in);
+	fclose(out);
+
+	unsigned char *eras = calloc(pnum, 1);
+	in = fopen(argv[4],"rb");
+	out = fopen(argv[5],"wb");
+	int erased = decUDPcrc(pnum,504,eras,in,out);
+	fclose(in);
+	fclose(out);
+
+	struct fecsess *s = sess_open(sess, 8, 4, 500);
+	in = fopen(argv[5],"rb");
+	long long kept = sess_addstream(s, 0, pnum, eras, in);
+	fclose(in);
+	free(eras);
+	printf("pass: %d erased, %lld kept, %lld groups missing\n",
+		erased, kept, sess_missing(s, NULL, 0));
+	sess_close(s);
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *in = fopen(argv[1],"rb");
+	FILE *out = fopen(argv[2],"wb");
+	int pnum = rskm(8,4,500,0,in,out) * 12;
+	fclose(in);
+	fclose(out);
+	printf("pnum: %d\n", pnum);
+
+	in = fopen(argv[2],"rb");
+	out = fopen(argv[3],"wb");
+	inlvUDPcrc(504,in,out);
+	fclose(in);
+	fclose(out);
+
+	unlink(argv[6]);
+	pass(argv[6], 12, pnum, argv);
+	pass(argv[6], 15, pnum, argv);
+
+	struct fecsess *s = sess_open(argv[6], 0, 0, 0);
+	out = fopen(argv[7],"wb");
+	printf("written: %lld groups\n", sess_write(s, out));
+	fclose(out);
+	sess_close(s);
+
+	// wrong bytes
+	long bad = 0, n = 0;
+	int a, b;
+	in = fopen(argv[1],"rb");
+	out = fopen(argv[7],"rb");
+	while ((a = fgetc(in)) != EOF)
+	{
+		b = fgetc(out);
+		n++;
+		bad += a != b;
+	}
+	fclose(in);
+	fclose(out);
+	printf("%ld bytes, %ld wrong\n", n, bad);
+	return 0;
+}
@@ -0,0 +1,94 @@
+#include "fec.c"
+
+// streamtest in coded scrambled out
+// rs255 then h74 as a stream, pushed and pulled in random sized pieces;
+// the coded bytes must be the pipeline's. Then bit errors, and back
+// through d_h74, d_rs255 as a stream; out should be in, padded to a
+// whole block.
+
+// Push all of f through s in pieces of 1 .. 5000 bytes, pulling up to
+// as much again after each; returns bytes written to out
+static long long run(struct fecstream *s, FILE *f, FILE *out)
+{
+	unsigned char buf[10000];
+	long long total = 0;
+	size_t got, n;
+
+	while ((got = fread(buf, 1, 1 + rand() % 5000, f)) > 0)
+	{
+		fecstream_push(s, buf, got);
+		while ((n = fecstream_pull(s, buf, 1 + rand() % 10000)) > 0)
+			total += fwrite(buf, 1, n, out);
+	}
+	fecstream_flush(s);
+	while ((n = fecstream_pull(s, buf, sizeof(buf))) > 0)
+		total += fwrite(buf, 1, n, out);
+	return total;
+}
+
+int main(int argc, char *argv[])
+{
+	struct fecstage enc[] = {
+		{ fecblk_rs255, (void *) 4, 223 * 4, 255 * 4 },
+		{ fecblk_h74, NULL, 255 * 4, 255 * 7 },
+	};
+	struct fecstage dec[] = {
+		{ fecblk_d_h74, NULL, 255 * 7, 255 * 4 },
+		{ fecblk_d_rs255, (void *) 4, 255 * 4, 255 * 4 },
+	};
+	srand(1);
+
+	FILE *in = fopen(argv[1],"rb");
+	FILE *out = fopen(argv[2],"wb");
+	struct fecstream *s = fecstream_new(enc, 2);
+	printf("encoded: %lld\n", run(s, in, out));
+	fecstream_free(s);
+	fclose(out);
+
+	// the same through the pipeline
+	rewind(in);
+	FILE *ref = tmpfile();
+	struct fecpipe *p = fecpipe_new(enc, 2, 2, 8);
+	fecpipe_run(p, in, ref);
+	fecpipe_free(p);
+	fclose(in);
+	rewind(ref);
+	out = fopen(argv[2],"rb");
+	long diff = 0;
+	int a, b;
+	while ((a = fgetc(ref)) != EOF)
+		diff += a != fgetc(out);
+	diff += fgetc(out) != EOF;
+	printf("differs from pipeline: %ld\n", diff);
+	fclose(ref);
+	fclose(out);
+
+	in = fopen(argv[2],"rb");
+	out = fopen(argv[3],"wb");
+	scram(9,in,out);
+	fclose(in);
+	fclose(out);
+
+	in = fopen(argv[3],"rb");
+	out = fopen(argv[4],"wb");
+	s = fecstream_new(dec, 2);
+	printf("decoded: %lld\n", run(s, in, out));
+	fecstream_free(s);
+	fclose(in);
+	fclose(out);
+
+	// wrong bytes
+	long bad = 0, n = 0;
+	in = fopen(argv[1],"rb");
+	out = fopen(argv[4],"rb");
+	while ((a = fgetc(in)) != EOF)
+	{
+		b = fgetc(out);
+		n++;
+		bad += a != b;
+	}
+	fclose(in);
+	fclose(out);
+	printf("%ld bytes, %ld wrong\n", n, bad);
+	return 0;
+}